@@ -25,7 +25,8 @@ function binaryPlayer(memorySize=256) {
         let memorySize = _memory.buffer.byteLength / 0x10000 // pages
         let timeLimit = 2000 // ms
         let difficultyLevel = _level || 0
-        let data = [memorySize, timeLimit, difficultyLevel]
+        let seed = 0, playouts = 0, nodes = 0 // no fixed budget, time_limit applies
+        let data = [memorySize, timeLimit, difficultyLevel, seed, playouts, nodes]
         let mem = new Uint32Array(_memory.buffer)
         for (let [i,x] of data.entries()) {
             mem[i] = x
@@ -52,15 +53,59 @@ function binaryPlayer(memorySize=256) {
         }
         return move
     }
+    function decodeReport() {
+        // search_report in arac.cpp, absent from older builds
+        if (!('search_report' in _instance.exports)) { return undefined }
+        let p = _instance.exports.search_report()
+        let u = new Uint32Array(_memory.buffer, p, 17)
+        let f = new Float32Array(_memory.buffer, p, 17)
+        let b = new Uint8Array(_memory.buffer, p + 14 * 4, 4)
+        return {playouts:u[1], elapsed:f[2], nodes:u[3], arenaUsed:u[4],
+            loadFactor:f[5], meanProbe:f[6], maxProbe:u[7], maxDepth:u[8],
+            dives:u[9], meanDive:u[9] ? u[10] / u[9] : 0,
+            phases:{setup:f[11], search:f[12], finish:f[13]}, book:b[3],
+            move:[b[0], b[1], b[2]], score:f[15], share:f[16]}
+    }
+    function decodeSnapshot() {
+        let p = _instance.exports.search_snapshot()
+        let u = new Uint32Array(_memory.buffer, p, 6)
+        let f = new Float32Array(_memory.buffer, p, 6)
+        let b = new Uint8Array(_memory.buffer, p, 24 + 8 * 4)
+        let pv = new Array()
+        for (let i = 0; i < u[5]; ++i) {
+            pv.push([b[24+4*i], b[25+4*i], b[26+4*i]])
+        }
+        return {playouts:u[0], elapsed:f[1], move:b[11] ? [b[8], b[9], b[10]] : undefined,
+            score:f[3], visits:u[4], pv}
+    }
+    // the search runs in steps of this many playouts, between them the
+    // worker sees its messages and the page gets a snapshot
+    const stepPlayouts = 1000
     async function inner(state) {
         encodeState(state)
-        let r = _instance.exports.select_move()
+        let r = 0
+        // search_step in arac.cpp, absent from older builds
+        if ('search_step' in _instance.exports) {
+            _moveNow = false
+            if (!_instance.exports.search_begin()) {
+                while (!_moveNow && !_instance.exports.search_step(stepPlayouts)) {
+                    postMessage(['snapshot', decodeSnapshot()])
+                    await new Promise(resolve => setTimeout(resolve, 0))
+                }
+            }
+            r = _instance.exports.search_end()
+        }
+        else {
+            r = _instance.exports.select_move()
+        }
         if (r) {
             r = decodeMove()
+            _report = decodeReport()
+            if (_report) { console.debug(JSON.stringify(_report)) }
         }
         return Promise.resolve(r)
     }
-    let _uid = 0, _level = undefined
+    let _uid = 0, _level = undefined, _report = undefined, _moveNow = false
     let _state = undefined
     let _module=undefined, _brain=undefined
     let _memory = new WebAssembly.Memory({initial:memorySize, maximum:memorySize}) // in pages
@@ -83,7 +128,11 @@ function binaryPlayer(memorySize=256) {
     }
     function discard() {
     }
-    return {init, update, getmove, discard}
+    // the search ends at its next step with the move it has
+    function movenow() {
+        _moveNow = true
+    }
+    return {init, update, getmove, discard, movenow}
 }
 
 
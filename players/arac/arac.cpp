@@ -1,22 +1,46 @@
 #include <stddef.h>
 #include <stdint.h>
+#if !__wasm__
+#include <string.h>
+#endif
 
 #define TRACE 0
+// scoped timers around the hot path, read through the profile_report export
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+// dive plies before the position is scored by static_eval, 0 plays it out
+#define DIVE_LIMIT 0
+
+#if __has_include("book.inc")
+#define BOOK 1
+#else
+#define BOOK 0
+#endif
 
 
 typedef int8_t i8;
+typedef int32_t i32;
 typedef uint8_t u8;
 typedef uint32_t u32;
 typedef uint64_t u64;
+typedef float r32;
 typedef double r64;
 
 
 extern void* __heap_base;
 
 
+// without __wasm__ the imports are plain declarations, for a native host
+#if __wasm__
 #define HOST_IMPORT(module, name) \
     __attribute__((import_module(#module))) \
     __attribute__((import_name(#name)))
+#define EXPORT(name) __attribute__((export_name(#name)))
+#else
+#define HOST_IMPORT(module, name)
+#define EXPORT(name)
+#endif
 
 HOST_IMPORT(host, time_now) r64 host_time_now(void);
 HOST_IMPORT(host, random) r64 host_random(void);
@@ -30,12 +54,72 @@ typedef struct __attribute__((packed)) {
     u32 memory_size; // pages
     u32 time_limit; // ms
     u32 difficulty_level;
+    u32 seed; // 0 seeds from host.random
+    u32 playouts; // per search, with nodes replaces time_limit
+    u32 nodes;
 } setup_data;
 
 
 static setup_data Config;
 
 
+// easy and medium, in playouts so they play the same on any device; hard
+// is Config's budget or time_limit. halving picks the root move by
+// sequential halving.
+static const struct {
+    u32 playouts;
+    u32 max_path;
+    u8 halving;
+} Levels[2] = {{10000, 3, 1}, {20000, 5, 1}};
+
+
+// what the last select_move did, one record per search. Hosts read it
+// from linear memory at the address the search_report export returns;
+// every field is 4 bytes, times are ms.
+typedef struct {
+    u32 version;
+    u32 playouts;
+    r32 elapsed;
+    u32 nodes;
+    u32 arena_used;
+    r32 load_factor;
+    r32 mean_probe;
+    u32 max_probe;
+    u32 max_depth;
+    u32 dives;
+    u32 dive_plies;
+    r32 setup_time;
+    r32 search_time;
+    r32 finish_time;
+    u8 from, to, pid, book;
+    r32 score;
+    r32 share;
+} search_report;
+
+
+static search_report Report;
+
+
+// the search so far, for hosts that take a move before it is over. It is
+// at the address the search_snapshot export returns, and search_step
+// fills it in: the move search_end would play now, and the line of
+// most visited replies below it. A move with ver 0 is none yet.
+#define SNAPSHOT_PV 8
+
+typedef struct {
+    u32 playouts;
+    r32 elapsed;
+    u8 from, to, pid, ver;
+    r32 score;
+    u32 visits;
+    u32 pv_length;
+    u8 pv[SNAPSHOT_PV][4]; // from, to, pid, 0
+} search_snapshot;
+
+
+static search_snapshot Snapshot;
+
+
 struct memory_arena {
     u8* end;
     u8 nomemory;
@@ -52,19 +136,9 @@ min(const T& a, const T& b) {
 }
 
 
-extern "C" {
-
-#if TRACE
-static u32 malloc_calls = 0;
-static u32 malloc_allocs = 0;
-#endif
-
+static
 void*
-malloc(size_t size) {
-    #if TRACE
-    ++malloc_calls;
-    malloc_allocs += size;
-    #endif
+arena_alloc(size_t size) {
     void* p = memory_arena->memory;
     if ((u8*)p + size >= memory_arena->end) {
         memory_arena->nomemory = 1;
@@ -75,6 +149,9 @@ malloc(size_t size) {
 }
 
 
+#if __wasm__
+extern "C" {
+
 #if 0
 void*
 memcpy(void* dest, const void* src, size_t n) {
@@ -118,6 +195,75 @@ memset(void* dest, int c, size_t n) {
 }
 
 }
+#endif
+
+
+enum {
+    PROFILE_MOVEGEN,
+    PROFILE_NEXT_STATE,
+    PROFILE_PACK,
+    PROFILE_LOOKUP,
+    PROFILE_SELECT,
+    PROFILE_ROLLOUT,
+    PROFILE_BACKUP,
+    PROFILE_PHASES,
+};
+
+
+#if PROFILE
+
+// counts of the last select_move, inclusive; ticks are cycles natively
+// and ns of host.time_now in wasm, which browsers round, so only sums
+// over many calls mean anything there
+typedef struct {
+    u64 ticks[PROFILE_PHASES];
+    u64 calls[PROFILE_PHASES];
+    u64 total;
+} profile_counters;
+
+
+static profile_counters Profile;
+
+
+static inline
+u64
+profile_ticks(void) {
+    #if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+    #else
+    return host_time_now() * 1000000;
+    #endif
+}
+
+
+struct profile_scope {
+    u32 phase;
+    u64 start;
+
+    profile_scope(u32 phase) : phase(phase), start(profile_ticks()) {}
+    ~profile_scope() {
+        Profile.ticks[phase] += profile_ticks() - start;
+        Profile.calls[phase] += 1;
+    }
+};
+
+
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_NAME(line) PROFILE_JOIN(profile_scope_, line)
+#define PROFILE_SCOPE(phase) profile_scope PROFILE_NAME(__LINE__)(phase)
+
+
+EXPORT(profile_report)
+profile_counters*
+profile_report(void) {
+    return &Profile;
+}
+
+#else
+
+#define PROFILE_SCOPE(phase)
+
+#endif
 
 
 typedef struct random_generator {
@@ -197,7 +343,7 @@ ao_list_upsert(S** s, const V& value) {
             return;
         }
     }
-    S* el = (S*) malloc(sizeof(S));
+    S* el = (S*) arena_alloc(sizeof(S));
     if (!el) { return; }
     *el = {.value=value, .tail=nullptr};
     *s = el;
@@ -300,7 +446,7 @@ kv_list_upsert(S** s, const K& key, const V& value) {
             return;
         }
     }
-    S* el = (S*) malloc(sizeof(S));
+    S* el = (S*) arena_alloc(sizeof(S));
     if (!el) { return; }
     *el = {.key=key, .value=value, .tail=nullptr};
     *s = el;
@@ -315,7 +461,7 @@ kv_list_get(S** s, const K& key) {
             return p->value;
         }
     }
-    S* el = (S*) malloc(sizeof(S));
+    S* el = (S*) arena_alloc(sizeof(S));
     if (!el) {
         static V x;
         x = V();
@@ -345,14 +491,25 @@ struct ao_map {
     }
 
     void insert(const K& key, const V& value) {
+        PROFILE_SCOPE(PROFILE_LOOKUP);
         auto h = hash_key(key);
         kv_list_upsert(&buckets[h], key, value);
     }
 
     V& get(const K& key) {
+        PROFILE_SCOPE(PROFILE_LOOKUP);
         auto h = hash_key(key);
         return kv_list_get<K,V>(&buckets[h], key);
     }
+
+    // null when key is not there, nothing is added
+    V* find(const K& key) {
+        PROFILE_SCOPE(PROFILE_LOOKUP);
+        for (auto p = buckets[hash_key(key)]; p; p = p->tail) {
+            if (p->key == key) { return &p->value; }
+        }
+        return nullptr;
+    }
 };
 
 
@@ -429,23 +586,23 @@ typedef struct __attribute((packed)) {
     union {
         u64 v;
         struct {
-            u8 _reserved: 4;
-            u8 prog1: 2;
-            u8 prog2: 2;
-            u8 prog3: 2;
-            u8 prog4: 2;
-            u8 prog_fix: 1;
-            u8 player: 1;
-            u8 player1_king: 5;
-            u8 player1_p1: 5;
-            u8 player1_p2: 5;
-            u8 player1_p4: 5;
-            u8 player1_p5: 5;
-            u8 player2_king: 5;
-            u8 player2_p1: 5;
-            u8 player2_p2: 5;
-            u8 player2_p4: 5;
-            u8 player2_p5: 5;
+            u64 _reserved: 4;
+            u64 prog1: 2;
+            u64 prog2: 2;
+            u64 prog3: 2;
+            u64 prog4: 2;
+            u64 prog_fix: 1;
+            u64 player: 1;
+            u64 player1_king: 5;
+            u64 player1_p1: 5;
+            u64 player1_p2: 5;
+            u64 player1_p4: 5;
+            u64 player1_p5: 5;
+            u64 player2_king: 5;
+            u64 player2_p1: 5;
+            u64 player2_p2: 5;
+            u64 player2_p4: 5;
+            u64 player2_p5: 5;
         };
     };
 } packed_state;
@@ -547,7 +704,9 @@ is_terminal(const game_state& state) {
 static
 packed_state
 pack_state(const game_state& state) {
-    packed_state packed = {.v=0};
+    PROFILE_SCOPE(PROFILE_PACK);
+    // missing pieces read as square 31, so every state packs to a distinct key
+    packed_state packed = {.v=~u64(0) << 14};
     packed.player = state.current_player - 1;
     u32 pi1 = 0, pi2 = 0;
     for (u32 i = 0; i < 25; ++i) {
@@ -616,6 +775,7 @@ pack_state(const game_state& state) {
 static
 game_state
 next_state(const game_state& state, const player_move& mv) {
+    PROFILE_SCOPE(PROFILE_NEXT_STATE);
     if (state.ended) { return state; }
     auto next = state;
     next.current_player = 3 - state.current_player;
@@ -651,7 +811,7 @@ next_state(const game_state& state, const player_move& mv) {
 
 typedef struct {
     u64 parent;
-    u32 wins;
+    r32 wins;
     u32 rounds;
 } monte_node;
 
@@ -660,6 +820,31 @@ typedef struct ao_array<player_move, 100> mc_valid;
 typedef struct ao_map<u64, monte_node, 0x8000> mc_stats;
 typedef struct ao_aset<u64, 0x100, 10> mc_seen;
 typedef struct ao_array<u64, 100> mc_path;
+typedef struct ao_array<player_move, 0x200> mc_moves;
+
+
+#define RAVE_EQUIV 500
+#define AMAF_MOVES (25 * 25 * 5)
+
+
+typedef struct {
+    r32 wins;
+    u32 rounds;
+    u32 stamp;
+} amaf_entry;
+
+
+// Sequential halving over the root moves: the playout budget is split
+// into ceil(log2(moves)) rounds; a round plays the moves left in turn,
+// then the worse half by score is dropped.
+typedef struct {
+    u32 alive[5 * 2 * 4]; // indices into the root's valid moves
+    u64 keys[5 * 2 * 4]; // the state each root move leads to
+    u32 count;
+    u32 next;
+    u32 round_size;
+    u32 round_end;
+} root_halving;
 
 
 typedef struct {
@@ -667,6 +852,18 @@ typedef struct {
     u64 root_id;
     u32 time_limit;
     u32 max_path;
+    u32 playout_limit;
+    u32 node_limit;
+    u32 playouts;
+    u32 nodes;
+    u8 halve;
+    u32 forced; // root move of this playout when halving
+    root_halving halving;
+    r64 start;
+    u32 total_runs;
+    u32 dt; // playouts since the clock was last looked at
+    u8 done;
+    amaf_entry amaf[2 * AMAF_MOVES];
     mc_stats stats;
 } mc_context;
 
@@ -674,6 +871,7 @@ typedef struct {
 static
 void
 valid_moves(mc_valid& valid, const game_state& state, u8 uid) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
     valid.clear();
     i8 rotate = 3 - 2 * uid;
     for (u32 y = 0; y < 5; ++y) {
@@ -696,33 +894,322 @@ valid_moves(mc_valid& valid, const game_state& state, u8 uid) {
 }
 
 
+
+static inline
+u32
+square_bit(u8 pos) {
+    return 1u << (pos / 10 * 5 + pos % 10);
+}
+
+
+static inline
+u8
+king_goal(u8 uid) {
+    return uid == 1 ? 2 : 42;
+}
+
+
+static inline
+u32
+piece_reach(const game_state& state, u8 pos, u8 uid) {
+    u32 mask = 0;
+    i8 rotate = 3 - 2 * uid;
+    for (u8 pid : own_progs(state, uid).v) {
+        for (i8 d : Progs[pid]) {
+            if (!d) { continue; }
+            u8 to = pos + d * rotate;
+            if (!on_board(to)) { continue; }
+            mask |= square_bit(to);
+        }
+    }
+    return mask;
+}
+
+
+static inline
+u8
+is_winning_move(const game_state& state, const player_move& mv) {
+    u8 piece = get_piece(state, mv.from);
+    return is_king(get_piece(state, mv.to)) || (is_king(piece) && mv.to == king_goal(piece / 10));
+}
+
+
+typedef struct {
+    player_move move;
+    u8 captured;
+    u8 slot; // of the hand the played prog left, 2 when the move ended the game
+    u8 current_player;
+    u8 ended;
+    u8 win;
+} move_undo;
+
+
+// next_state in place for a game still on, undone by unmake_move
+static inline
+void
+make_move(game_state& state, const player_move& mv, move_undo& undo) {
+    PROFILE_SCOPE(PROFILE_NEXT_STATE);
+    u8 uid = state.current_player;
+    u8 piece = get_piece(state, mv.from);
+    undo = {.move=mv, .captured=get_piece(state, mv.to), .slot=2, .current_player=uid, .ended=state.ended, .win=state.win};
+    state.ended = is_winning_move(state, mv);
+    set_piece(state, mv.from, 0);
+    set_piece(state, mv.to, piece);
+    if (state.ended) {
+        state.win = 1;
+        return;
+    }
+    state.current_player = 3 - uid;
+    for (u8 i = 0; i < 2; ++i) {
+        u8 pid = state.player_progs[uid-1][i];
+        if (pid == mv.pid) {
+            state.player_progs[uid-1][i] = state.decked_prog;
+            state.decked_prog = pid;
+            undo.slot = i;
+            break;
+        }
+    }
+}
+
+
+static inline
+void
+unmake_move(game_state& state, const move_undo& undo) {
+    u8 uid = undo.current_player;
+    if (undo.slot < 2) {
+        u8 pid = state.decked_prog;
+        state.decked_prog = state.player_progs[uid-1][undo.slot];
+        state.player_progs[uid-1][undo.slot] = pid;
+    }
+    set_piece(state, undo.move.from, get_piece(state, undo.move.to));
+    set_piece(state, undo.move.to, undo.captured);
+    state.current_player = uid;
+    state.ended = undo.ended;
+    state.win = undo.win;
+}
+
+
+typedef struct {
+    u8 count;
+    u8 pos[5];
+    u32 reach[5];
+    u8 king;
+    u8 own_king;
+    u8 goal_blocked;
+} threat_map;
+
+
+static
+void
+threat_map_init(threat_map& threats, const game_state& state) {
+    u8 uid = state.current_player;
+    u8 opp = 3 - uid;
+    threats = {.king=0xff, .own_king=0xff};
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        u8 pos = i / 5 * 10 + i % 5;
+        if (is_own(piece, opp)) {
+            if (is_king(piece)) { threats.king = threats.count; }
+            threats.pos[threats.count] = pos;
+            threats.reach[threats.count] = piece_reach(state, pos, opp);
+            ++threats.count;
+        }
+        else if (is_king(piece)) {
+            threats.own_king = pos;
+        }
+    }
+    u8 goal = get_piece(state, king_goal(opp));
+    threats.goal_blocked = is_own(goal, opp);
+}
+
+
 static
 u8
-mc_dive(const game_state& root_state, const player_move& first_move) {
+is_losing_move(const threat_map& threats, const game_state& state, const player_move& mv) {
+    u8 opp = 3 - state.current_player;
+    u8 king = is_king(get_piece(state, mv.from)) ? mv.to : threats.own_king;
+    u32 reach = 0;
+    for (u32 i = 0; i < threats.count; ++i) {
+        if (threats.pos[i] == mv.to) { continue; }
+        reach |= threats.reach[i];
+    }
+    if (reach & square_bit(king)) { return 1; }
+    if (threats.king == 0xff || threats.pos[threats.king] == mv.to) { return 0; }
+    u8 goal = king_goal(opp);
+    u8 blocked = threats.goal_blocked && mv.to != goal;
+    return !blocked && (threats.reach[threats.king] & square_bit(goal));
+}
+
+#define EVAL_PAWN 1.0
+#define EVAL_KING_STEP 0.3
+#define EVAL_MOBILITY 0.05
+#define EVAL_SCALE 0.5
+
+
+static inline
+i32
+abs(i32 x) {
+    return x < 0 ? -x : x;
+}
+
+
+static
+r64
+static_eval(const game_state& state, u8 uid) {
+    if (state.ended) {
+        return state.current_player == uid;
+    }
+    u8 side = state.current_player;
+    u32 own[2] = {}, kings[2] = {};
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        own[piece / 10 - 1] |= 1u << i;
+        if (is_king(piece)) { kings[piece / 10 - 1] = 1u << i; }
+    }
+    r64 score[2] = {};
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        u8 owner = piece / 10;
+        u8 pos = i / 5 * 10 + i % 5;
+        u32 reach = piece_reach(state, pos, owner) & ~own[owner-1];
+        u32 wins = reach & kings[2-owner];
+        score[owner-1] += EVAL_MOBILITY * __builtin_popcount(reach);
+        if (is_king(piece)) {
+            u8 goal = king_goal(owner);
+            i32 dy = i32(pos / 10) - goal / 10;
+            i32 dx = i32(pos % 10) - goal % 10;
+            score[owner-1] -= EVAL_KING_STEP * (abs(dy) + abs(dx));
+            wins |= reach & square_bit(goal);
+        }
+        else {
+            score[owner-1] += EVAL_PAWN;
+        }
+        if (owner == side && wins) {
+            return side == uid;
+        }
+    }
+    r64 x = EVAL_SCALE * (score[uid-1] - score[2-uid]);
+    return 0.5 + 0.5 * x / (1 + (x < 0 ? -x : x));
+}
+
+#if BOOK
+typedef struct __attribute__((packed)) {
+    u64 key;
+    u8 from;
+    u8 to;
+    u8 pid;
+    u8 score;
+} book_entry;
+
+#include "book.inc"
+
+static
+u8
+book_probe(const game_state& state, player_move* mv) {
+    u64 key = pack_state(state).v;
+    u32 lo = 0, hi = sizeof(Book) / sizeof(Book[0]);
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (Book[mid].key < key) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    if (lo == sizeof(Book) / sizeof(Book[0]) || Book[lo].key != key) { return 0; }
+    auto& entry = Book[lo];
+    mc_valid valid;
+    valid_moves(valid, state, state.current_player);
+    for (u32 i = 0; i < valid.size(); ++i) {
+        auto& x = valid.values[i];
+        if (x.from == entry.from && x.to == entry.to && x.pid == entry.pid) {
+            *mv = x;
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+
+#define DIVE_CAPTURE_WEIGHT 4
+
+
+// take a win, else sample moves that do not lose at once, captures first;
+// the move is made on state
+static
+u8
+dive_policy(game_state& state, mc_valid& valid, mc_seen& seen, player_move* played) {
+    move_undo undo;
+    for (u32 i = 0; i < valid.size(); ++i) {
+        if (is_winning_move(state, valid.values[i])) {
+            make_move(state, valid.values[i], undo);
+            *played = valid.values[i];
+            return 1;
+        }
+    }
+    threat_map threats;
+    threat_map_init(threats, state);
+    u32 weight[5 * 2 * 4];
+    u8 losing[5 * 2 * 4];
+    u32 total = 0;
+    for (u32 i = 0; i < valid.size(); ++i) {
+        auto& mv = valid.values[i];
+        losing[i] = is_losing_move(threats, state, mv);
+        weight[i] = losing[i] ? 0 : get_piece(state, mv.to) ? DIVE_CAPTURE_WEIGHT : 1;
+        total += weight[i];
+    }
+    for (u8 pass = 0; pass < 2; ++pass) {
+        while (total) {
+            u32 r = random.range(total);
+            u32 i = 0;
+            for (; r >= weight[i]; ++i) { r -= weight[i]; }
+            make_move(state, valid.values[i], undo);
+            auto k = pack_state(state).v;
+            if (!seen.has(k)) {
+                seen.insert(k);
+                *played = valid.values[i];
+                return 1;
+            }
+            unmake_move(state, undo);
+            total -= weight[i];
+            weight[i] = 0;
+            losing[i] = 0;
+        }
+        for (u32 i = 0; i < valid.size(); ++i) {
+            if (losing[i]) {
+                weight[i] = 1;
+                total += 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+static
+r64
+mc_dive(const game_state& root_state, const player_move& first_move, mc_moves& moves) {
     u8 uid = root_state.current_player;
     mc_seen seen = {};
     auto state = root_state;
     seen.insert(pack_state(state).v);
-    state = next_state(state, first_move);
+    move_undo undo;
+    make_move(state, first_move, undo);
     seen.insert(pack_state(state).v);
     mc_valid valid;
-    while (!state.ended) {
-        valid_moves(valid, state, state.current_player);
-        while (valid.size()) {
-            u32 i = random.range(valid.size());
-            auto mv = valid.values[i];
-            auto nextState = next_state(state, mv);
-            auto k = pack_state(nextState).v;
-            if (seen.has(k)) {
-                valid.erase(i);
-            }
-            else {
-                seen.insert(k);
-                state = nextState;
-                break;
-            }
+    PROFILE_SCOPE(PROFILE_ROLLOUT);
+    Report.dives += 1;
+    for (u32 ply = 1; !state.ended; ++ply, ++Report.dive_plies) {
+        #if DIVE_LIMIT
+        if (ply == DIVE_LIMIT) {
+            return static_eval(state, uid);
         }
-        if (!valid.size()) { break; }
+        #endif
+        valid_moves(valid, state, state.current_player);
+        player_move mv;
+        if (!dive_policy(state, valid, seen, &mv)) { break; }
+        if (moves.size() < moves.capacity()) { moves.append(mv); }
     }
     return state.current_player == uid;
 }
@@ -738,9 +1225,47 @@ uct1(r64 wins, r64 rounds, r64 parent_rounds) {
 }
 
 
-#if TRACE
-static u32 max_path = 0;
-#endif
+static inline
+u32
+amaf_index(u8 uid, const player_move& mv) {
+    u32 from = mv.from / 10 * 5 + mv.from % 10;
+    u32 to = mv.to / 10 * 5 + mv.to % 10;
+    return ((uid - 1) * 25 * 25 + from * 25 + to) * 5 + mv.pid;
+}
+
+
+static inline
+r64
+sqrt(r64 x) {
+    return __builtin_sqrt(x);
+}
+
+
+// node value pulled towards the move's all-moves-as-first rate while young
+static inline
+r64
+uct_rave(r64 wins, r64 rounds, r64 parent_rounds, const amaf_entry& amaf) {
+    r64 beta = sqrt(RAVE_EQUIV / (3 * rounds + RAVE_EQUIV));
+    r64 q = wins / rounds;
+    r64 a = amaf.rounds ? amaf.wins / amaf.rounds : q;
+    return uct1(wins, rounds, parent_rounds) + beta * (a - q);
+}
+
+
+static
+void
+amaf_update(mc_context* context, u8 uid, const mc_moves& moves, u32 last, r64 win) {
+    u32 stamp = context->playouts;
+    r64 result = last % 2 ? 1 - win : win;
+    for (u32 i = 0; i < moves.size(); ++i, uid = 3 - uid, result = 1 - result) {
+        auto& entry = context->amaf[amaf_index(uid, moves.values[i])];
+        if (entry.stamp == stamp) { continue; }
+        entry.stamp = stamp;
+        entry.wins += result;
+        entry.rounds += 1;
+    }
+}
+
 
 static
 u8
@@ -751,42 +1276,50 @@ mc_playout(mc_context* context) {
     u64 selected_id = parent_id;
     mc_seen seen = {};
     mc_path path = {};
+    mc_moves moves;
+    moves.clear();
     seen.insert(parent_id);
     path.append(parent_id);
+    context->playouts += 1;
     mc_valid valid;
-    game_state best_state;
+    move_undo undo;
 
     while (!parent_state.ended && path.size() < path.capacity()) {
         if ((context->max_path && path.size() >= context->max_path) || memory_arena->nomemory) { break; }
+        PROFILE_SCOPE(PROFILE_SELECT);
         valid_moves(valid, parent_state, parent_state.current_player);
         if (!valid.size()) { return 0; }
         player_move best_move = player_pass;
         u64 best_id = 0;
         r64 bestW = -1e20;
         for (u32 vi = 0; vi < valid.size(); ++vi) {
+            if (context->halve && path.size() == 1 && vi != context->forced) { continue; }
             auto& mv = valid.values[vi];
-            auto ns = next_state(parent_state, mv);
-            u64 nsid = pack_state(ns).v;
+            make_move(parent_state, mv, undo);
+            u64 nsid = pack_state(parent_state).v;
+            u8 ended = parent_state.ended;
+            unmake_move(parent_state, undo);
             if (seen.has(nsid)) { continue; }
             seen.insert(nsid);
             r64 wei = 0;
             auto parent_rounds = context->stats.get(parent_id).rounds;
             auto& stats = context->stats.get(nsid);
+            auto& rave = context->amaf[amaf_index(parent_state.current_player, mv)];
             if (!stats.parent) {
                 context->stats.insert(nsid, {.parent=parent_id, .wins=0, .rounds=1});
-                wei = uct1(0, 1, parent_rounds);
+                context->nodes += 1;
+                wei = uct_rave(0, 1, parent_rounds, rave);
             }
             else {
-                wei = uct1(stats.wins, stats.rounds, parent_rounds);
+                wei = uct_rave(stats.wins, stats.rounds, parent_rounds, rave);
             }
-            if (ns.ended) {
+            if (ended) {
                 wei = 100;
             }
             if (wei > bestW) {
                 bestW = wei;
                 best_id = nsid;
                 best_move = mv;
-                best_state = ns;
             }
         }
 
@@ -797,31 +1330,32 @@ mc_playout(mc_context* context) {
         }
 
         path.append(best_id);
+        moves.append(best_move);
         auto& stats = context->stats.get(best_id);
         if (stats.rounds == 1) {
             selected_move = best_move;
             selected_id = best_id;
             break;
         }
-        else {
-            parent_state = best_state;
-            parent_id = best_id;
-        }
+        make_move(parent_state, best_move, undo);
+        parent_id = best_id;
     }
 
-    u8 win = 0;
+    r64 win = 0;
+    u32 last = moves.size() - 1;
     if (parent_state.ended) {
         win = parent_state.win;
     }
     else {
-        win = mc_dive(parent_state, selected_move);
+        win = mc_dive(parent_state, selected_move, moves);
+    }
+    if (moves.size()) {
+        amaf_update(context, context->root_state.current_player, moves, last, win);
     }
 
-    #if TRACE
-    if (path.size() > max_path) {
-        max_path = path.size();
+    if (path.size() > Report.max_depth) {
+        Report.max_depth = path.size();
     }
-    #endif
 
     #if 0
     if (win && path.size() > 1) {
@@ -832,17 +1366,82 @@ mc_playout(mc_context* context) {
     #endif
 
     for (size_t i = path.size(); i; --i) {
+        PROFILE_SCOPE(PROFILE_BACKUP);
         auto q = path.values[i-1];
         auto& node = context->stats.get(q);
         node.wins += win;
         node.rounds += 1;
-        win = !win;
+        win = 1 - win;
     }
 
     return 1;
 }
 
 
+static
+r64
+root_halving_score(mc_context* context, u32 i) {
+    const monte_node& node = context->stats.get(context->halving.keys[i]);
+    return node.rounds ? r64(node.wins) / r64(node.rounds) : -1;
+}
+
+
+static
+void
+root_halving_init(mc_context* context) {
+    auto& h = context->halving;
+    auto& root_state = context->root_state;
+    mc_valid valid;
+    valid_moves(valid, root_state, root_state.current_player);
+    context->halve = valid.size() > 1 && context->playout_limit;
+    if (!context->halve) { return; }
+    u32 rounds = 1;
+    while ((1u << rounds) < valid.size()) { ++rounds; }
+    for (u32 i = 0; i < valid.size(); ++i) {
+        h.alive[i] = i;
+        h.keys[i] = pack_state(next_state(root_state, valid.values[i])).v;
+    }
+    h.count = valid.size();
+    h.next = 0;
+    h.round_size = context->playout_limit / rounds;
+    h.round_end = h.round_size;
+}
+
+
+// the root move to play next, halving the field once spent ends a round
+static
+u32
+root_halving_next(mc_context* context, u32 spent) {
+    auto& h = context->halving;
+    if (spent >= h.round_end && h.count > 1) {
+        // insertion sort, best first and stable
+        for (u32 i = 1; i < h.count; ++i) {
+            u32 a = h.alive[i];
+            r64 score = root_halving_score(context, a);
+            u32 j = i;
+            for (; j && root_halving_score(context, h.alive[j-1]) < score; --j) {
+                h.alive[j] = h.alive[j-1];
+            }
+            h.alive[j] = a;
+        }
+        h.count = (h.count + 1) / 2;
+        h.next = 0;
+        h.round_end += h.round_size;
+    }
+    return h.alive[h.next++ % h.count];
+}
+
+
+static
+u8
+root_halving_alive(const root_halving& h, u32 i) {
+    for (u32 k = 0; k < h.count; ++k) {
+        if (h.alive[k] == i) { return 1; }
+    }
+    return 0;
+}
+
+
 static
 player_move
 mc_best_move(mc_context* context) {
@@ -859,101 +1458,484 @@ mc_best_move(mc_context* context) {
         // u64 q = root_states[mv.v];
         const monte_node& node = context->stats.get(q);
         if (!node.rounds) { continue; }
+        // the halving's last round decides between the moves it kept
+        if (context->halve && !root_halving_alive(context->halving, i)) { continue; }
         r64 score = r64(node.wins) / r64(node.rounds);
         if (score > bestScore) {
             bestScore = score;
             best = mv;
+            Report.score = score;
+            Report.share = r64(node.rounds - 1) / context->playouts;
         }
     }
     return best;
 }
 
 
+// node count, load and chain lengths of the tree, for the report
 static
-player_move
-monte_move(mc_context* context, const game_state& root_state) {
-    if (root_state.ended) {
-        return player_pass;
+void
+mc_stats_report(const mc_stats& stats) {
+    const u32 buckets = sizeof(stats.buckets) / sizeof(stats.buckets[0]);
+    u32 nodes = 0, probes = 0, longest = 0;
+    for (u32 b = 0; b < buckets; ++b) {
+        u32 n = 0;
+        for (auto p = stats.buckets[b]; p; p = p->tail) { ++n; }
+        nodes += n;
+        probes += n * (n + 1) / 2;
+        if (n > longest) { longest = n; }
     }
-    r64 start = host_time_now();
-    r64 time_limit = context->time_limit;
+    Report.nodes = nodes;
+    Report.load_factor = r64(nodes) / buckets;
+    Report.mean_probe = nodes ? r64(probes) / nodes : 0;
+    Report.max_probe = longest;
+}
 
+
+// a search on root_state, run by mc_step and ended by mc_finish
+static
+void
+mc_begin(mc_context* context, const game_state& root_state) {
+    context->start = host_time_now();
     context->root_state = root_state;
     auto root_id = pack_state(root_state).v;
     context->root_id = root_id;
     context->stats.clear();
     context->stats.insert(root_id, {0, 0, 1});
+    if (context->halve) { root_halving_init(context); }
+    context->total_runs = 0;
+    context->dt = 0;
+    context->done = root_state.ended;
+}
+
 
-    u32 total_runs = 0;
-    for (u32 dt = 0; ; ++dt) {
-        ++total_runs;
-        if (!mc_playout(context)) { break; }
+// up to runs playouts; 1 once the search is over
+static
+u8
+mc_step(mc_context* context, u32 runs) {
+    u8 budget = context->playout_limit || context->node_limit;
+    for (u32 i = 0; i < runs && !context->done; ++i) {
+        ++context->total_runs;
+        if (context->halve) { context->forced = root_halving_next(context, context->total_runs - 1); }
+        if (!mc_playout(context)) {
+            context->done = 1;
+            break;
+        }
 
-        if (dt == 10000) {
-            dt = 0;
-            r64 now = host_time_now();
-            r64 elapsed = now - start;
-            if (elapsed >= time_limit) { break; }
+        if (budget) {
+            // the clock is not looked at, the same inputs play the same
+            if (context->playout_limit && context->total_runs >= context->playout_limit) { context->done = 1; }
+            if (context->node_limit && context->nodes >= context->node_limit) { context->done = 1; }
         }
+        else if (context->dt == 10000) {
+            context->dt = 0;
+            if (host_time_now() - context->start >= context->time_limit) { context->done = 1; }
+        }
+        ++context->dt;
     }
-    #if TRACE
-    host_trace_log(total_runs);
-    #endif
+    if (!budget && !context->done && host_time_now() - context->start >= context->time_limit) {
+        context->done = 1;
+    }
+    return context->done;
+}
+
+
+// the move of the search so far, however far it got
+static
+player_move
+mc_finish(mc_context* context) {
+    if (context->root_state.ended) {
+        return player_pass;
+    }
+    r64 searched = host_time_now();
+    Report.playouts = context->total_runs;
+    Report.search_time = searched - context->start;
+
+    auto mv = mc_best_move(context);
+    mc_stats_report(context->stats);
+    Report.finish_time = host_time_now() - searched;
+    return mv;
+}
+
 
-    return mc_best_move(context);
+static
+player_move
+monte_move(mc_context* context, const game_state& root_state) {
+    mc_begin(context, root_state);
+    while (!mc_step(context, ~0u)) {}
+    return mc_finish(context);
 }
 
 
-__attribute__((export_name("select_move")))
+// the search select_move runs, in steps for hosts that want to see it or
+// cut it short
+static mc_context* Search = nullptr;
+static player_move SearchMove;
+static r64 SearchStart;
+#if PROFILE
+static u64 SearchTicks;
+#endif
+
+
+// the state at __heap_base as the root of a new search; 1 when the move
+// is known without one (the book, or the game is over)
+EXPORT(search_begin)
 u8
-select_move(void) {
+search_begin(void) {
+    r64 start = host_time_now();
+    SearchStart = start;
+    #if PROFILE
+    SearchTicks = profile_ticks();
+    #endif
     game_state state;
     state.data = *(game_state_data*)__heap_base;
     state.ended = is_terminal(state);
 
     memory_arena->memory = memory_arena->arena;
     memory_arena->nomemory = 0;
+    Report = {.version=1};
+    Snapshot = {};
+    #if PROFILE
+    Profile = {};
+    #endif
 
-    mc_context* context = (mc_context*) malloc(sizeof(mc_context));
+    mc_context* context = (mc_context*) arena_alloc(sizeof(mc_context));
     memset(context, 0, sizeof(mc_context));
+    Search = context;
 
     context->time_limit = Config.time_limit;
-    switch (Config.difficulty_level) {
-        case 0:
-            context->time_limit = min<u32>(500, Config.time_limit);
-            context->max_path = 3;
-            break;
-        case 1:
-            context->time_limit = min<u32>(1000, Config.time_limit);
-            context->max_path = 5;
-            break;
+    context->playout_limit = Config.playouts;
+    context->node_limit = Config.nodes;
+    if (Config.difficulty_level < 2) {
+        auto& level = Levels[Config.difficulty_level];
+        context->playout_limit = level.playouts;
+        context->max_path = level.max_path;
+        context->halve = level.halving;
     }
 
-    #if TRACE
-    malloc_calls = 0;
-    malloc_allocs = 0;
-    max_path = 0;
+    if (Config.seed) {
+        random.seed((Config.seed ^ pack_state(state).v) * 0x9e3779b97f4a7c15ULL);
+    }
+    else {
+        random.seed(host_random() * 9007199254740992.0);
+    }
+    player_move mv = player_pass;
+    #if BOOK
+    // easy levels stay weak, the book is for full strength play
+    if (Config.difficulty_level >= 2) {
+        Report.book = book_probe(state, &mv);
+    }
     #endif
+    Report.setup_time = host_time_now() - start;
+    SearchMove = mv;
+    if (mv.v != player_pass.v) { return 1; }
+    mc_begin(context, state);
+    return context->done;
+}
 
-    random.seed(host_random());
-    player_move mv = monte_move(context, state);
 
-    #if TRACE
-    host_trace_log(malloc_calls);
-    host_trace_log(malloc_allocs);
-    host_trace_log(max_path);
-    #endif
+static
+void
+mc_snapshot(mc_context* context) {
+    auto& s = Snapshot;
+    s.playouts = context->total_runs;
+    s.elapsed = host_time_now() - SearchStart;
+    s.ver = 0;
+    s.score = -1;
+    s.visits = 0;
+    s.pv_length = 0;
+    auto state = context->root_state;
+    mc_valid valid;
+    move_undo undo;
+    for (u32 ply = 0; ply < SNAPSHOT_PV && !state.ended; ++ply) {
+        valid_moves(valid, state, state.current_player);
+        player_move next = player_pass;
+        r64 best = -1;
+        u32 most = 0;
+        for (u32 i = 0; i < valid.size(); ++i) {
+            auto& mv = valid.values[i];
+            make_move(state, mv, undo);
+            auto node = context->stats.find(pack_state(state).v);
+            unmake_move(state, undo);
+            if (!node || !node->rounds) { continue; }
+            // the root move as mc_best_move picks it
+            if (!ply && context->halve && !root_halving_alive(context->halving, i)) { continue; }
+            u32 visits = node->rounds - 1;
+            r64 score = r64(node->wins) / r64(node->rounds);
+            if (ply ? visits > most : score > best) {
+                best = score;
+                most = visits;
+                next = mv;
+            }
+        }
+        if (next.v == player_pass.v || (ply && !most)) { break; }
+        if (!ply) {
+            s.from = next.from;
+            s.to = next.to;
+            s.pid = next.pid;
+            s.ver = 1;
+            s.score = best;
+            s.visits = most;
+        }
+        u8* q = s.pv[s.pv_length++];
+        q[0] = next.from;
+        q[1] = next.to;
+        q[2] = next.pid;
+        q[3] = 0;
+        make_move(state, next, undo);
+    }
+}
+
+
+// up to playouts more of the search, then the snapshot; 1 once the search
+// is over, by its budget or time_limit
+EXPORT(search_step)
+u8
+search_step(u32 playouts) {
+    if (SearchMove.v != player_pass.v || !Search) { return 1; }
+    u8 done = mc_step(Search, playouts);
+    mc_snapshot(Search);
+    return done;
+}
+
+
+EXPORT(search_snapshot)
+search_snapshot*
+last_search_snapshot(void) {
+    return &Snapshot;
+}
+
+
+// the move of the search however far it got, written to __heap_base as
+// select_move writes it
+EXPORT(search_end)
+u8
+search_end(void) {
+    player_move mv = SearchMove;
+    if (mv.v == player_pass.v && Search) {
+        mv = mc_finish(Search);
+    }
+    Search = nullptr;
 
     player_move_data res;
     res = mv.data;
     res.ver = 1;
     *(player_move_data*)__heap_base = res;
+    Report.from = mv.from;
+    Report.to = mv.to;
+    Report.pid = mv.pid;
+    Report.arena_used = memory_arena->memory - memory_arena->arena;
+    Report.elapsed = host_time_now() - SearchStart;
+    #if PROFILE
+    Profile.total = profile_ticks() - SearchTicks;
+    #endif
 
     return 1;
 }
 
 
-__attribute__((export_name("setup")))
+EXPORT(select_move)
+u8
+select_move(void) {
+    if (!search_begin()) {
+        while (!mc_step(Search, ~0u)) {}
+    }
+    return search_end();
+}
+
+
+// The rules and a short exhaustive search for the page's own code, so it
+// need not keep a second copy. A state is read from __heap_base as for
+// select_move; moves and keys go to __heap_base + RULES_IO.
+#define RULES_IO 32
+
+
+static
+game_state
+rules_state(void) {
+    game_state state;
+    state.data = *(game_state_data*)__heap_base;
+    state.ended = is_terminal(state);
+    state.win = state.ended;
+    return state;
+}
+
+
+// the moves of the side to move, 4 bytes each (ver 1, from, to, pid); how many
+EXPORT(move_list)
+u32
+move_list(void) {
+    auto state = rules_state();
+    if (state.ended) { return 0; }
+    mc_valid valid;
+    valid_moves(valid, state, state.current_player);
+    auto out = (player_move_data*)((u8*)__heap_base + RULES_IO);
+    for (u32 i = 0; i < valid.size(); ++i) {
+        out[i] = valid.values[i].data;
+        out[i].ver = 1;
+    }
+    return valid.size();
+}
+
+
+// the move at RULES_IO played on the state, which is written back: 0 when
+// the move is not valid, 2 when it ends the game (the winner stays the
+// player to move), 1 otherwise
+EXPORT(state_next)
+u8
+state_next(void) {
+    auto state = rules_state();
+    if (state.ended) { return 0; }
+    player_move mv;
+    mv.data = *(player_move_data*)((u8*)__heap_base + RULES_IO);
+    mv._reserved = 0;
+    mc_valid valid;
+    valid_moves(valid, state, state.current_player);
+    u8 found = 0;
+    for (u32 i = 0; i < valid.size() && !found; ++i) {
+        found = valid.values[i].v == mv.v;
+    }
+    if (!found) { return 0; }
+    move_undo undo;
+    make_move(state, mv, undo);
+    *(game_state_data*)__heap_base = state.data;
+    return state.ended ? 2 : 1;
+}
+
+
+// pack_state's key of the state, 8 bytes at RULES_IO
+EXPORT(state_key)
+u8
+state_key(void) {
+    *(u64*)((u8*)__heap_base + RULES_IO) = pack_state(rules_state()).v;
+    return 1;
+}
+
+
+// Exhaustive alpha-beta for the page's brute player. It scores as the page
+// did: a win BRUTE_WIN less the plies to it, otherwise 10 a piece ahead.
+#define BRUTE_WIN 100
+
+
+typedef struct {
+    u32 nodes;
+    u32 node_limit;
+    u8 stopped;
+} brute_budget;
+
+
+static
+i32
+brute_material(const game_state& state, u8 uid) {
+    i32 score = 0;
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (piece) { score += is_own(piece, uid) ? 10 : -10; }
+    }
+    return score;
+}
+
+
+static
+i32
+brute_search(game_state& state, u32 depth, u32 ply, i32 alpha, i32 beta, brute_budget& budget) {
+    if (++budget.nodes > budget.node_limit && budget.node_limit) {
+        budget.stopped = 1;
+        return 0;
+    }
+    u8 uid = state.current_player;
+    mc_valid valid;
+    valid_moves(valid, state, uid);
+    for (u32 i = 0; i < valid.size(); ++i) {
+        if (is_winning_move(state, valid.values[i])) { return BRUTE_WIN - ply - 1; }
+    }
+    if (!depth || !valid.size()) { return brute_material(state, uid); }
+    move_undo undo;
+    // captures first, then the quiet moves
+    for (u8 pass = 0; pass < 2; ++pass) {
+        for (u32 i = 0; i < valid.size(); ++i) {
+            auto& mv = valid.values[i];
+            if ((get_piece(state, mv.to) == 0) != pass) { continue; }
+            make_move(state, mv, undo);
+            i32 score = -brute_search(state, depth - 1, ply + 1, -beta, -alpha, budget);
+            unmake_move(state, undo);
+            if (budget.stopped) { return 0; }
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) { return alpha; }
+            }
+        }
+    }
+    return alpha;
+}
+
+
+// the best move to depth plies, deepened a ply at a time while the nodes
+// last; written to __heap_base as select_move writes it. Returns the
+// depth searched in full, 0 when there is no move or the nodes ran out
+// before depth 1 was done, and nothing is written then.
+EXPORT(brute_move)
+u32
+brute_move(u32 depth, u32 node_limit) {
+    auto state = rules_state();
+    if (state.ended) { return 0; }
+    mc_valid valid;
+    valid_moves(valid, state, state.current_player);
+    if (!valid.size()) { return 0; }
+    auto answer = [](player_move mv, u32 reached) {
+        player_move_data res = mv.data;
+        res.ver = 1;
+        *(player_move_data*)__heap_base = res;
+        return reached;
+    };
+    // a win in one needs no search, whatever the budget
+    for (u32 i = 0; i < valid.size(); ++i) {
+        if (is_winning_move(state, valid.values[i])) { return answer(valid.values[i], 1); }
+    }
+    brute_budget budget = {.nodes=0, .node_limit=node_limit, .stopped=0};
+    player_move best = valid.values[0];
+    u32 reached = 0;
+    move_undo undo;
+    for (u32 d = 1; d <= depth && !budget.stopped; ++d) {
+        // the last depth's move first, it tightens the window soonest
+        for (u32 i = 0; i < valid.size(); ++i) {
+            if (valid.values[i].v != best.v) { continue; }
+            valid.values[i] = valid.values[0];
+            valid.values[0] = best;
+        }
+        player_move pick = best;
+        i32 alpha = -BRUTE_WIN - 1;
+        for (u32 i = 0; i < valid.size() && !budget.stopped; ++i) {
+            auto& mv = valid.values[i];
+            i32 score = BRUTE_WIN - 1;
+            if (!is_winning_move(state, mv)) {
+                make_move(state, mv, undo);
+                score = -brute_search(state, d - 1, 1, -BRUTE_WIN - 1, -alpha, budget);
+                unmake_move(state, undo);
+            }
+            if (!budget.stopped && score > alpha) {
+                alpha = score;
+                pick = mv;
+            }
+        }
+        if (budget.stopped) { break; }
+        best = pick;
+        reached = d;
+        if (alpha >= BRUTE_WIN - i32(d)) { break; }
+    }
+    if (!reached) { return 0; }
+    return answer(best, reached);
+}
+
+
+EXPORT(search_report)
+search_report*
+last_search_report(void) {
+    return &Report;
+}
+
+
+EXPORT(setup)
 void
 setup(void) {
     Config = *(setup_data*)__heap_base;
@@ -0,0 +1,227 @@
+// cc -std=c++20 -lc++ -O3 -o bench bench.cpp
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+
+// arac as the browser runs it, with the host imports supplied here and
+// its linear memory a plain buffer
+namespace arac {
+#include "arac.cpp"
+
+void* __heap_base = nullptr;
+
+static std::mt19937_64 HostRandom;
+static u8 HostTrace = 0;
+
+r64
+host_time_now(void) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<r64, std::milli>(now).count();
+}
+
+r64
+host_random(void) {
+    return std::uniform_real_distribution<r64>(0, 1)(HostRandom);
+}
+
+void
+host_trace_log(u32 x) {
+    if (HostTrace) { fprintf(stderr, "trace: %u\n", x); }
+}
+}
+
+
+using std::vector;
+using arac::u8;
+using arac::u32;
+using arac::u64;
+using arac::r64;
+
+
+#if PROFILE
+static
+void
+profile_dump(FILE* out) {
+    static const char* names[arac::PROFILE_PHASES] = {
+        "movegen", "next_state", "pack", "lookup", "select", "rollout", "backup",
+    };
+    auto& p = *arac::profile_report();
+    fprintf(out, "%-10s %12s       %10" PRIu64 " ticks\n", "search", "", p.total);
+    for (u32 i = 0; i < arac::PROFILE_PHASES; ++i) {
+        if (!p.calls[i]) { continue; }
+        fprintf(out, "%-10s %12" PRIu64 " calls %10.1f ticks/call %6.1f%%\n", names[i], p.calls[i],
+            r64(p.ticks[i]) / p.calls[i], p.total ? 100.0 * p.ticks[i] / p.total : 0);
+    }
+}
+#endif
+
+
+static
+vector<arac::game_state_data>
+opening_corpus(void) {
+    vector<arac::game_state_data> corpus;
+    arac::game_state_data data = {};
+    data.current_player = 1;
+    for (u32 x = 0; x < 5; ++x) {
+        data.board[0][x] = 21 + x;
+        data.board[4][x] = 11 + x;
+    }
+    // one of each hand pairing, the order within a hand does not matter
+    const u8 hands[][5] = {
+        {0, 1, 2, 3, 4}, {0, 1, 3, 2, 4}, {0, 1, 4, 2, 3}, {0, 2, 3, 1, 4}, {0, 2, 4, 1, 3},
+        {0, 3, 4, 1, 2}, {1, 0, 2, 3, 4}, {2, 0, 1, 3, 4}, {3, 0, 1, 2, 4}, {4, 0, 1, 2, 3},
+    };
+    for (auto& progs : hands) {
+        memcpy(data.progs, progs, 5);
+        corpus.push_back(data);
+    }
+    return corpus;
+}
+
+
+static
+u8
+read_corpus(const char* path, vector<arac::game_state_data>& corpus) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return 0;
+    }
+    arac::game_state_data data;
+    while (fread(&data, sizeof(data), 1, fp) == 1) {
+        corpus.push_back(data);
+    }
+    fclose(fp);
+    return 1;
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-i corpus] [-l level] [-t ms] [-n playouts] [-x nodes] [-m pages] [-s seed] [-e playouts] [-b depth] [-v]\n", name);
+    fprintf(stderr, "  -i  positions as 31-byte states (default: opening hands)\n");
+    fprintf(stderr, "  -l  difficulty level (default 2)\n");
+    fprintf(stderr, "  -t  time limit per move in ms (default 2000, as the page sets it)\n");
+    fprintf(stderr, "  -n  playouts per move instead of time\n");
+    fprintf(stderr, "  -x  tree nodes per move instead of time\n");
+    fprintf(stderr, "  -m  memory in 64 KiB pages (default 256, as the page sets it)\n");
+    fprintf(stderr, "  -s  search seed, with -n or -x every run plays the same (default: host.random)\n");
+    fprintf(stderr, "  -e  step the search this many playouts at a time, a snapshot line after each\n");
+    fprintf(stderr, "  -b  the page's brute player instead, alpha-beta to depth within -x nodes\n");
+    fprintf(stderr, "  -v  print host.trace_log calls\n");
+}
+
+
+// select_move as a host that watches the search runs it
+static
+u8
+step_move(u32 step) {
+    if (!arac::search_begin()) {
+        for (u8 done = 0; !done; ) {
+            done = arac::search_step(step);
+            auto& s = *arac::last_search_snapshot();
+            printf("{\"snapshot\":{\"playouts\":%u,\"elapsed\":%.1f,\"move\":", s.playouts, s.elapsed);
+            if (s.ver) { printf("[%u,%u,%u]", s.from, s.to, s.pid); }
+            else { printf("null"); }
+            printf(",\"score\":%.4f,\"visits\":%u,\"pv\":[", s.score, s.visits);
+            for (u32 i = 0; i < s.pv_length; ++i) {
+                printf("%s[%u,%u,%u]", i ? "," : "", s.pv[i][0], s.pv[i][1], s.pv[i][2]);
+            }
+            printf("]}}\n");
+        }
+    }
+    return arac::search_end();
+}
+
+
+int main(int argc, char* argv[]) {
+    vector<arac::game_state_data> corpus;
+    arac::setup_data config = {.memory_size=256, .time_limit=2000, .difficulty_level=2};
+    u32 step = 0, depth = 0;
+    for (int opt; (opt = getopt(argc, argv, "i:l:t:n:x:m:s:e:b:vh")) != -1; ) {
+        switch (opt) {
+            case 'i':
+                if (!read_corpus(optarg, corpus)) { return 1; }
+                break;
+            case 'l': config.difficulty_level = atoi(optarg); break;
+            case 't': config.time_limit = atoi(optarg); break;
+            case 'n': config.playouts = atoi(optarg); break;
+            case 'x': config.nodes = atoi(optarg); break;
+            case 'm': config.memory_size = atoi(optarg); break;
+            case 's': config.seed = strtoul(optarg, nullptr, 0); break;
+            case 'e': step = atoi(optarg); break;
+            case 'b': depth = atoi(optarg); break;
+            case 'v': arac::HostTrace = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (corpus.empty()) { corpus = opening_corpus(); }
+    arac::HostRandom.seed(std::random_device{}());
+
+    size_t memory_size = size_t(config.memory_size) * 0x10000;
+    void* memory = aligned_alloc(0x10000, memory_size);
+    if (!memory) {
+        perror("memory");
+        return 1;
+    }
+    memset(memory, 0, memory_size);
+    arac::__heap_base = memory;
+    memcpy(memory, &config, sizeof(config));
+    arac::setup();
+
+    u64 playouts = 0;
+    r64 seconds = 0;
+    u32 arena_high = 0;
+    for (auto& data : corpus) {
+        memcpy(memory, &data, sizeof(data));
+        if (depth) {
+            auto start = std::chrono::steady_clock::now();
+            u32 reached = arac::brute_move(depth, config.nodes);
+            std::chrono::duration<r64> elapsed = std::chrono::steady_clock::now() - start;
+            seconds += elapsed.count();
+            auto mv = (arac::player_move_data*)memory;
+            printf("{\"engine\":\"arac-brute\",\"depth\":%u,\"seconds\":%.4f,\"move\":", reached, elapsed.count());
+            if (reached) { printf("{\"from\":%u,\"to\":%u,\"pid\":%u}}\n", mv->from, mv->to, mv->pid); }
+            else { printf("null}\n"); }
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        u8 ok = step ? step_move(step) : arac::select_move();
+        std::chrono::duration<r64> elapsed = std::chrono::steady_clock::now() - start;
+        auto& r = *arac::last_search_report();
+        playouts += r.playouts;
+        seconds += elapsed.count();
+        if (r.arena_used > arena_high) { arena_high = r.arena_used; }
+        // the fields of search_report, as brute writes its records
+        printf("{\"engine\":\"arac\",\"playouts\":%u,\"playouts_per_second\":%.0f,\"seconds\":%.4f,"
+            "\"nodes\":%u,\"bytes\":%u,\"load_factor\":%.3f,\"mean_probe\":%.3f,\"max_probe\":%u,"
+            "\"max_depth\":%u,\"dives\":%u,\"mean_dive\":%.2f,"
+            "\"phases\":{\"setup\":%.4f,\"search\":%.4f,\"finish\":%.4f},\"book\":%u,\"full\":%u,",
+            r.playouts, r.elapsed > 0 ? r.playouts * 1000 / r.elapsed : 0, r.elapsed / 1000,
+            r.nodes, r.arena_used, r.load_factor, r.mean_probe, r.max_probe,
+            r.max_depth, r.dives, r.dives ? r64(r.dive_plies) / r.dives : 0,
+            r.setup_time / 1000, r.search_time / 1000, r.finish_time / 1000, r.book,
+            arac::memory_arena->nomemory);
+        if (!ok || r.from == 0xff) {
+            printf("\"move\":null}\n");
+        }
+        else {
+            printf("\"move\":{\"from\":%u,\"to\":%u,\"pid\":%u,\"score\":%.4f,\"share\":%.4f}}\n",
+                r.from, r.to, r.pid, r.score, r.share);
+        }
+        #if PROFILE
+        profile_dump(stderr);
+        #endif
+    }
+    fprintf(stderr, "%zu positions, %.0f playouts/s, arena high-water %u KiB of %zu\n", corpus.size(),
+        seconds > 0 ? playouts / seconds : 0, arena_high >> 10, memory_size >> 10);
+    free(memory);
+    return 0;
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "book.h"
+#include "engine.h"
+
+
+// Batch analysis: a file of game_state_data records in, one
+// analysis_record per position out, in the same order. The input is
+// mmap'd and read once front to back, results go straight to their place
+// in the output with pwrite, so neither file has to fit in memory.
+
+
+#define ANALYSIS_CHUNK 64
+
+
+typedef struct __attribute__((packed)) {
+    player_move_data move; // ver 0 when the position has no move
+    r32 score; // win rate of the move for the side to move
+    u32 playouts;
+} analysis_record;
+
+
+typedef struct {
+    const char* input;
+    const char* output;
+    u32 threads;
+    r64 time_limit;
+    u32 playouts;
+    u32 nodes;
+    u32 dive_limit;
+    u8 halving;
+    const opening_book* book;
+} analysis_config;
+
+
+static
+game_state
+state_from_data(const game_state_data& data) {
+    game_state state = {};
+    state.current_player = data.current_player;
+    for (u32 y = 0; y < 5; ++y) {
+        for (u32 x = 0; x < 5; ++x) {
+            state.board[y][x] = data.board[y][x];
+        }
+    }
+    for (u32 x = 0; x < 5; ++x) {
+        state.progs[x] = data.progs[x];
+    }
+    state.ended = is_terminal(state);
+    return state;
+}
+
+
+static
+analysis_record
+analyse_position(const analysis_config& config, const game_state_data& data) {
+    auto state = state_from_data(data);
+    analysis_record record = {};
+    player_move mv = player_pass;
+    r64 score = 0;
+    u32 playouts = 0;
+    if (book_probe(*config.book, state, &mv)) {
+        auto entry = book_find(config.book->entries, config.book->count, pack_state(state).v);
+        score = entry->score / 255.0;
+    }
+    else if (!state.ended && !tb_probe_move(Tablebase, state, &mv, &score)) {
+        u64 before = Playouts;
+        mv = Network.header ? puct_move(state, config.time_limit, &score) : monte_move(state, config.time_limit, &score);
+        playouts = Playouts - before;
+    }
+    if (mv.v != player_pass.v) {
+        record.move = {.ver=1, .from=mv.from, .to=mv.to, .pid=mv.pid};
+        record.score = score;
+    }
+    record.playouts = playouts;
+    return record;
+}
+
+
+static
+int
+analyse(const analysis_config& config) {
+    int in = open(config.input, O_RDONLY);
+    if (in < 0) {
+        perror(config.input);
+        return 1;
+    }
+    struct stat st;
+    fstat(in, &st);
+    u64 count = st.st_size / sizeof(game_state_data);
+    if (st.st_size % sizeof(game_state_data)) {
+        fprintf(stderr, "%s: not a whole number of %zu-byte states\n", config.input, sizeof(game_state_data));
+    }
+    const game_state_data* positions = nullptr;
+    if (count) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, in, 0);
+        if (p == MAP_FAILED) {
+            perror(config.input);
+            close(in);
+            return 1;
+        }
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        positions = (const game_state_data*) p;
+    }
+    close(in);
+    int out = open(config.output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0 || ftruncate(out, count * sizeof(analysis_record))) {
+        perror(config.output);
+        if (positions) { munmap((void*) positions, st.st_size); }
+        if (out >= 0) { close(out); }
+        return 1;
+    }
+
+    Verbose = 0;
+    std::atomic<u64> next(0);
+    std::atomic<u64> done(0);
+    std::atomic<u8> failed(0);
+    std::mutex lock;
+    auto start = chrono::steady_clock::now();
+    vector<std::thread> workers;
+    for (u32 t = 0; t < config.threads; ++t) {
+        workers.emplace_back([&]() {
+            DiveLimit = config.dive_limit;
+            PlayoutLimit = config.playouts;
+            NodeLimit = config.nodes;
+            RootHalving = config.halving;
+            analysis_record records[ANALYSIS_CHUNK];
+            for (u64 first; !failed && (first = next.fetch_add(ANALYSIS_CHUNK)) < count; ) {
+                u64 n = std::min<u64>(ANALYSIS_CHUNK, count - first);
+                for (u64 i = 0; i < n; ++i) {
+                    records[i] = analyse_position(config, positions[first + i]);
+                }
+                size_t bytes = n * sizeof(analysis_record);
+                if (pwrite(out, records, bytes, first * sizeof(analysis_record)) != ssize_t(bytes)) {
+                    perror(config.output);
+                    failed = 1;
+                    break;
+                }
+                u64 total = done += n;
+                chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+                std::lock_guard<std::mutex> guard(lock);
+                fprintf(stderr, "%" PRIu64 " / %" PRIu64 " positions, %.1f/s\n", total, count, total / elapsed.count());
+            }
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+    if (positions) { munmap((void*) positions, st.st_size); }
+    close(out);
+    return failed;
+}
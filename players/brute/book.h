@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game.h"
+
+
+// Opening book: packed_state key -> best move and its win rate, sorted by
+// key for binary search. bookgen -c dumps the same entries as a C array
+// for arac.
+
+
+#define BOOK_MAGIC "MPBK"
+#define BOOK_VERSION 1
+
+
+typedef struct __attribute__((packed)) {
+    u64 key;
+    u8 from;
+    u8 to;
+    u8 pid;
+    u8 score; // win rate, 0..255
+} book_entry;
+
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 count;
+    u32 _reserved;
+} book_header;
+
+
+typedef struct {
+    const book_entry* entries;
+    u32 count;
+    size_t size;
+    const void* data;
+} opening_book;
+
+
+static
+u8
+book_open(opening_book& book, const char* path) {
+    book = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || size_t(st.st_size) < sizeof(book_header)) {
+        fprintf(stderr, "%s: not an opening book\n", path);
+        close(fd);
+        return 0;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+    auto header = (const book_header*) p;
+    if (memcmp(header->magic, BOOK_MAGIC, 4) || header->version != BOOK_VERSION ||
+        sizeof(book_header) + header->count * sizeof(book_entry) > size_t(st.st_size)) {
+        fprintf(stderr, "%s: not an opening book\n", path);
+        munmap(p, st.st_size);
+        return 0;
+    }
+    book.data = p;
+    book.size = st.st_size;
+    book.count = header->count;
+    book.entries = (const book_entry*)(header + 1);
+    return 1;
+}
+
+
+static
+void
+book_close(opening_book& book) {
+    if (book.data) {
+        munmap((void*) book.data, book.size);
+    }
+    book = {};
+}
+
+
+static
+const book_entry*
+book_find(const book_entry* entries, u32 count, u64 key) {
+    u32 lo = 0, hi = count;
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (entries[mid].key < key) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    if (lo < count && entries[lo].key == key) {
+        return &entries[lo];
+    }
+    return nullptr;
+}
+
+
+// returns 0 when the position is not in the book
+static
+u8
+book_probe(const opening_book& book, const game_state& state, player_move* mv) {
+    if (!book.count || state.ended) { return 0; }
+    auto entry = book_find(book.entries, book.count, pack_state(state).v);
+    if (!entry) { return 0; }
+    for (auto& valid : valid_moves(state, state.current_player)) {
+        if (valid.from == entry->from && valid.to == entry->to && valid.pid == entry->pid) {
+            *mv = valid;
+            return 1;
+        }
+    }
+    return 0;
+}
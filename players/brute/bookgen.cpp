@@ -0,0 +1,189 @@
+// cc -std=c++20 -lc++ -O3 -pthread -o bookgen bookgen.cpp
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "engine.h"
+#include "book.h"
+
+
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+
+static
+vector<game_state>
+opening_positions(u32 plies) {
+    game_state state = {};
+    state.current_player = 1;
+    for (u32 x = 0; x < 5; ++x) {
+        state.board[0][x] = 21 + x;
+        state.board[4][x] = 11 + x;
+    }
+    vector<game_state> positions, fringe;
+    unordered_set<u64> seen;
+    u8 progs[5] = {0, 1, 2, 3, 4};
+    do {
+        for (u32 i = 0; i < 5; ++i) { state.progs[i] = progs[i]; }
+        if (seen.insert(pack_state(state).v).second) {
+            fringe.push_back(state);
+        }
+    } while (std::next_permutation(progs, progs + 5));
+
+    for (u32 ply = 0; ply <= plies && !fringe.empty(); ++ply) {
+        vector<game_state> next;
+        for (auto& s : fringe) {
+            positions.push_back(s);
+            if (ply == plies) { continue; }
+            for (auto& mv : valid_moves(s, s.current_player)) {
+                auto ns = next_state(s, mv);
+                if (ns.ended) { continue; }
+                if (seen.insert(pack_state(ns).v).second) {
+                    next.push_back(ns);
+                }
+            }
+        }
+        fringe.swap(next);
+    }
+    return positions;
+}
+
+
+static
+u8
+write_book(const char* path, const vector<book_entry>& entries) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return 0;
+    }
+    book_header header = {};
+    memcpy(header.magic, BOOK_MAGIC, 4);
+    header.version = BOOK_VERSION;
+    header.count = entries.size();
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(entries.data(), sizeof(book_entry), entries.size(), fp);
+    if (ferror(fp) | fclose(fp)) {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
+
+
+static
+u8
+write_include(const char* path, const vector<book_entry>& entries) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return 0;
+    }
+    fprintf(fp, "// generated by bookgen, do not edit\n");
+    fprintf(fp, "static const book_entry Book[] = {\n");
+    for (auto& e : entries) {
+        fprintf(fp, "    {0x%016" PRIx64 ", %u, %u, %u, %u},\n", e.key, e.from, e.to, e.pid, e.score);
+    }
+    fprintf(fp, "};\n");
+    if (ferror(fp) | fclose(fp)) {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-d plies] [-t seconds] [-j threads] [-i book] [-o book] [-c include]\n", name);
+    fprintf(stderr, "  -d  book positions up to this many plies from the opening (default 1)\n");
+    fprintf(stderr, "  -t  search time per position, 0 keeps only positions from -i (default 10)\n");
+    fprintf(stderr, "  -j  parallel searches (default: all cores)\n");
+    fprintf(stderr, "  -i  reuse entries from an existing book\n");
+    fprintf(stderr, "  -o  output book (default brute.book)\n");
+    fprintf(stderr, "  -c  also write the entries as a C array, for arac\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    u32 plies = 1;
+    r64 time_limit = 10;
+    u32 threads = std::thread::hardware_concurrency();
+    const char* input = nullptr;
+    const char* output = nullptr;
+    const char* include = nullptr;
+    for (int opt; (opt = getopt(argc, argv, "d:t:j:i:o:c:h")) != -1; ) {
+        switch (opt) {
+            case 'd': plies = atoi(optarg); break;
+            case 't': time_limit = atof(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'i': input = optarg; break;
+            case 'o': output = optarg; break;
+            case 'c': include = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (!threads) { threads = 1; }
+    if (!output && !include) { output = "brute.book"; }
+    Verbose = 0;
+
+    unordered_map<u64, book_entry> known;
+    if (input) {
+        opening_book book;
+        if (!book_open(book, input)) { return 1; }
+        for (u32 i = 0; i < book.count; ++i) {
+            known[book.entries[i].key] = book.entries[i];
+        }
+        book_close(book);
+    }
+
+    auto positions = opening_positions(plies);
+    vector<game_state> todo;
+    vector<book_entry> entries;
+    for (auto& s : positions) {
+        auto it = known.find(pack_state(s).v);
+        if (it != known.end()) { entries.push_back(it->second); }
+        else if (time_limit > 0) { todo.push_back(s); }
+    }
+    fprintf(stderr, "%zu positions, %zu from book, %zu to search\n",
+        positions.size(), entries.size(), todo.size());
+
+    std::atomic<u32> next(0);
+    std::mutex lock;
+    vector<std::thread> workers;
+    for (u32 t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            for (;;) {
+                u32 i = next.fetch_add(1);
+                if (i >= todo.size()) { break; }
+                r64 score = 0;
+                auto mv = monte_move(todo[i], time_limit, &score);
+                if (mv.v == player_pass.v) { continue; }
+                book_entry e = {
+                    .key=pack_state(todo[i]).v,
+                    .from=mv.from, .to=mv.to, .pid=mv.pid,
+                    .score=u8(std::clamp(score, 0.0, 1.0) * 255),
+                };
+                std::lock_guard<std::mutex> guard(lock);
+                entries.push_back(e);
+                fprintf(stderr, "%zu/%zu %02u-%02u(%u): %.2f\n",
+                    entries.size(), positions.size(), e.from, e.to, e.pid, score);
+            }
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+
+    std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.key < b.key; });
+    if (output && !write_book(output, entries)) { return 1; }
+    if (include && !write_include(include, entries)) { return 1; }
+    return 0;
+}
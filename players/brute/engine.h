@@ -0,0 +1,1213 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "game.h"
+#include "nn.h"
+#include "tablebase.h"
+#include "telemetry.h"
+#include "ttable.h"
+
+
+namespace chrono = std::chrono;
+using std::deque;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+
+static tablebase Tablebase;
+static neural_net Network;
+static shared_table SharedTable;
+static u8 Verbose = 1;
+// dive plies before the position is scored by static_eval, 0 plays it out
+static thread_local u32 DiveLimit = 0;
+// playouts and tree nodes per search; with either set the clock is not
+// looked at, so a search plays the same on any machine
+static thread_local u32 PlayoutLimit = 0;
+static thread_local u32 NodeLimit = 0;
+// every search reseeds from this and the root position, 0 keeps drawing
+// from the system
+static u64 Seed = 0;
+static thread_local std::default_random_engine Rng(std::random_device{}());
+// playouts run by this thread so far, for speed reports
+static thread_local u64 Playouts = 0;
+// search records go here as JSON lines, to stderr when only Verbose
+static FILE* Telemetry = nullptr;
+// what the last search on this thread did
+static thread_local search_metrics Metrics;
+// searches stop here whatever their budget, a slice at a time leaves the
+// report to whoever runs the slices
+static thread_local chrono::steady_clock::time_point Deadline = chrono::steady_clock::time_point::max();
+static thread_local u8 Sliced = 0;
+// a search run inside another one leaves the report to that one
+static thread_local u8 Nested = 0;
+// monte_move writes a search_snapshot line here every SnapshotInterval
+// seconds while it searches
+static FILE* Snapshots = nullptr;
+static r64 SnapshotInterval = 0;
+
+
+// node table access, counted as lookup when profiling
+template<typename M>
+static inline
+auto
+node_find(M& table, u64 key) {
+    PROFILE_SCOPE(PROFILE_LOOKUP);
+    return table.find(key);
+}
+
+
+template<typename M>
+static inline
+auto&
+node_get(M& table, u64 key) {
+    PROFILE_SCOPE(PROFILE_LOOKUP);
+    return table[key];
+}
+
+
+// difficulty levels, easy to hard, as playouts per search; 0 is no budget
+static const u32 LevelPlayouts[] = {10000, 20000, 0};
+// and whether the root moves are chosen by sequential halving
+static const u8 LevelHalving[] = {1, 1, 0};
+static thread_local u8 RootHalving = 0;
+
+
+static
+void
+search_seed(const game_state& root_state) {
+    if (!Seed) { return; }
+    u64 h = (Seed ^ pack_state(root_state).v) * 0x9e3779b97f4a7c15ULL;
+    Rng.seed(u32(h >> 32));
+}
+
+
+static inline
+u8
+search_spent(u32 playouts, size_t nodes, chrono::duration<r64> elapsed, chrono::duration<r64> time_limit) {
+    if (Deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= Deadline) {
+        return 1;
+    }
+    if (PlayoutLimit || NodeLimit) {
+        return (PlayoutLimit && playouts >= PlayoutLimit) || (NodeLimit && nodes >= NodeLimit);
+    }
+    return elapsed >= time_limit;
+}
+
+
+static
+void
+metrics_report(void) {
+    if (Sliced || Nested) { return; }
+    FILE* out = Telemetry ? Telemetry : Verbose ? stderr : nullptr;
+    if (out) { metrics_write(out, Metrics); }
+    profile_dump(stderr);
+}
+
+
+template<typename T>
+static
+const T&
+random_element(const vector<T>& v) {
+    std::uniform_int_distribution<u32> distribution(0, v.size()-1);
+    u32 i = distribution(Rng);
+    return v[i];
+}
+
+
+static
+player_move
+random_move(const game_state& state) {
+    search_seed(state);
+    auto valid = valid_moves(state, state.current_player);
+    if (!valid.size()) {
+        return {};
+    }
+    return random_element(valid);
+}
+
+
+// standard setup with shuffled progs, then some random plies
+template<typename R>
+static
+game_state
+random_opening(R& rng, u32 plies) {
+    game_state state = {};
+    state.current_player = 1;
+    for (u32 x = 0; x < 5; ++x) {
+        state.board[0][x] = 21 + x;
+        state.board[4][x] = 11 + x;
+    }
+    u8 progs[5] = {0, 1, 2, 3, 4};
+    std::shuffle(progs, progs + 5, rng);
+    for (u32 i = 0; i < 5; ++i) { state.progs[i] = progs[i]; }
+    for (u32 ply = 0; ply < plies && !state.ended; ++ply) {
+        auto valid = valid_moves(state, state.current_player);
+        if (valid.empty()) { break; }
+        state = next_state(state, valid[std::uniform_int_distribution<u32>(0, valid.size()-1)(rng)]);
+    }
+    return state;
+}
+
+
+typedef struct {
+    u32 depth;
+    game_state state;
+    player_move moved;
+} brute_state;
+
+
+static
+player_move
+brute_move(const game_state& state, u32 max_depth) {
+    if (state.ended) {
+        return player_pass;
+    }
+    u8 uid = state.current_player;
+    deque<brute_state> fringe;
+    unordered_set<u64> seen;
+    seen.insert(pack_state(state).v);
+    for (auto& mv : valid_moves(state, state.current_player)) {
+        fringe.push_back({1, next_state(state, mv), mv});
+    }
+    unordered_map<u32, i32> stats;
+    unordered_map<u32, u32> hits;
+    u32 total = 0;
+    while (!fringe.empty()) {
+        auto search = fringe.front();
+        fringe.pop_front();
+        auto k = pack_state(search.state).v;
+        if (seen.find(k) != seen.end()) { continue; }
+        seen.insert(k);
+        ++total;
+        vector<player_move> valid;
+        u8 is_terminal = search.state.ended || search.depth >= max_depth;
+        if (!is_terminal) {
+            valid = valid_moves(search.state, search.state.current_player);
+            if (valid.empty()) {
+                // no move loses, as if the other side had won
+                search.state.ended = 1;
+                search.state.win = 1;
+                search.state.current_player = 3 - search.state.current_player;
+                is_terminal = 1;
+            }
+        }
+        if (is_terminal) {
+            i32 score = get_score(search.state, uid) - search.depth;
+#if 0
+            for (u32 y = 0; y < 5; ++y) {
+                for (u32 x = 0; x < 5; ++x) {
+                    fprintf(stderr, "%02d ", search.state.board[y][x]);
+                }
+                fprintf(stderr, "\n");
+            }
+            fprintf(stderr, "score: %d\n\n", score);
+#endif
+            i8 me = search.state.current_player == uid;
+            if ((me && score > 0) || (!me && score < 0)) {
+                auto q = search.moved.v;
+                stats[q] += score;
+                hits[q] += 1;
+            }
+            continue;
+        }
+        for (auto& mv : valid) {
+            fringe.push_back({search.depth+1, next_state(search.state, mv), search.moved});
+        }
+    }
+    Playouts += total;
+    auto best = player_pass;
+    r64 bestScore = -std::numeric_limits<r64>::infinity();
+    for (auto& p : stats) {
+        r64 s = r64(p.second) / r64(hits[p.first]);
+        player_move q = {.v=p.first};
+        if (s > bestScore) {
+            bestScore = s;
+            best = q;
+        }
+    }
+    return best;
+}
+
+
+// relative odds of a capture against a quiet move in a dive
+#define DIVE_CAPTURE_WEIGHT 4
+
+
+// heavy playout policy: take a win when there is one, otherwise sample
+// moves that do not lose on the spot, captures first. Moves back into a
+// seen position are dropped; 0 when nothing is left. The move is made on
+// state.
+template<typename R>
+static
+u8
+dive_policy(game_state& state, const vector<player_move>& valid, unordered_set<u64>& seen, R& rng, player_move* played) {
+    move_undo undo;
+    for (auto& mv : valid) {
+        if (is_winning_move(state, mv)) {
+            make_move(state, mv, undo);
+            *played = mv;
+            return 1;
+        }
+    }
+    threat_map threats;
+    threat_map_init(threats, state);
+    u32 weight[5 * 2 * 4];
+    u8 losing[5 * 2 * 4];
+    u32 total = 0;
+    for (u32 i = 0; i < valid.size(); ++i) {
+        auto& mv = valid[i];
+        losing[i] = is_losing_move(threats, state, mv);
+        weight[i] = losing[i] ? 0 : get_piece(state, mv.to) ? DIVE_CAPTURE_WEIGHT : 1;
+        total += weight[i];
+    }
+    for (u8 pass = 0; pass < 2; ++pass) {
+        while (total) {
+            u32 r = std::uniform_int_distribution<u32>(0, total-1)(rng);
+            u32 i = 0;
+            for (; r >= weight[i]; ++i) { r -= weight[i]; }
+            make_move(state, valid[i], undo);
+            if (seen.insert(pack_state(state).v).second) {
+                *played = valid[i];
+                return 1;
+            }
+            unmake_move(state, undo);
+            total -= weight[i];
+            weight[i] = 0;
+            losing[i] = 0;
+        }
+        // only losing moves left, any of them will do
+        for (u32 i = 0; i < valid.size(); ++i) {
+            if (losing[i]) {
+                weight[i] = 1;
+                total += 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+// chance the side to move in root_state wins after first_move
+// moves played after first_move are appended to moves, when given
+static
+r64
+mc_dive(const game_state& root_state, const player_move& first_move, vector<player_move>* moves = nullptr) {
+    u8 uid = root_state.current_player;
+    unordered_set<u64> seen;
+    auto state = root_state;
+    seen.insert(pack_state(state).v);
+    move_undo undo;
+    make_move(state, first_move, undo);
+    seen.insert(pack_state(state).v);
+    PROFILE_SCOPE(PROFILE_ROLLOUT);
+    Metrics.dives += 1;
+    for (u32 ply = 1; !state.ended; ++ply, ++Metrics.dive_plies) {
+        u8 value = 0;
+        if (tb_probe(Tablebase, state, &value) && value) {
+            return (state.current_player == uid) == tb_is_win(value);
+        }
+        if (ply == DiveLimit) {
+            return static_eval(state, uid);
+        }
+        auto valid = valid_moves(state, state.current_player);
+        if (valid.empty()) { return state.current_player != uid; }
+        player_move mv;
+        if (!dive_policy(state, valid, seen, Rng, &mv)) { break; }
+        if (moves) { moves->push_back(mv); }
+    }
+    return state.current_player == uid;
+}
+
+
+// Sequential halving over the root moves: the budget, in playouts or
+// seconds, is split into ceil(log2(moves)) rounds; a round plays the moves
+// left in turn, then the worse half by score is dropped. It spends a
+// fixed budget on telling the best move apart rather than on the value
+// of each.
+typedef struct {
+    vector<u32> alive; // indices into the root's valid_moves
+    u32 next;
+    u32 played; // playouts so far, a search may come back for more
+    r64 round_size;
+    r64 round_end;
+} root_halving;
+
+
+static
+void
+root_halving_init(root_halving& h, u32 moves, r64 budget) {
+    u32 rounds = 1;
+    while ((1u << rounds) < moves) { ++rounds; }
+    h.alive.clear();
+    for (u32 i = 0; i < moves; ++i) { h.alive.push_back(i); }
+    h.next = 0;
+    h.played = 0;
+    h.round_size = budget / rounds;
+    h.round_end = h.round_size;
+}
+
+
+// the root move to play next, halving the field once spent ends a round
+template<typename F>
+static
+u32
+root_halving_next(root_halving& h, r64 spent, F score) {
+    if (spent >= h.round_end && h.alive.size() > 1) {
+        std::stable_sort(h.alive.begin(), h.alive.end(), [&](u32 a, u32 b) { return score(a) > score(b); });
+        h.alive.resize((h.alive.size() + 1) / 2);
+        h.next = 0;
+        h.round_end += h.round_size;
+    }
+    h.played += 1;
+    return h.alive[h.next++ % h.alive.size()];
+}
+
+
+static inline
+u8
+root_halving_alive(const root_halving& h, u32 i) {
+    return std::find(h.alive.begin(), h.alive.end(), i) != h.alive.end();
+}
+
+
+static
+player_move
+shallow_move(const game_state& state, r64 time_limit) {
+    if (state.ended) {
+        return player_pass;
+    }
+    chrono::duration<r64> tlimit(time_limit);
+    auto start = chrono::steady_clock::now();
+    search_seed(state);
+    auto valid = valid_moves(state, state.current_player);
+    if (valid.empty()) { return player_pass; }
+    Metrics = {.engine="shallow"};
+    profile_reset();
+    vector<r64> wins(valid.size());
+    vector<u32> plays(valid.size());
+    auto score = [&](u32 i) { return plays[i] ? wins[i] / plays[i] : -1; };
+    // without a playout budget it halves by the clock; a node budget means nothing here
+    root_halving halving = {};
+    u8 halve = RootHalving && valid.size() > 1;
+    if (halve) { root_halving_init(halving, valid.size(), PlayoutLimit ? PlayoutLimit : time_limit); }
+    u32 played = 0;
+    for (;;) {
+        chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+        u32 vi = halve ? root_halving_next(halving, PlayoutLimit ? halving.played : elapsed.count(), score) : played % valid.size();
+        wins[vi] += mc_dive(state, valid[vi]);
+        plays[vi] += 1;
+        played += 1;
+        Playouts += 1;
+        if (search_spent(played, 0, elapsed, tlimit)) { break; }
+    }
+    auto best = player_pass;
+    r64 bestScore = -std::numeric_limits<r64>::infinity();
+    u32 bestPlays = 0;
+    for (u32 i = 0; i < valid.size(); ++i) {
+        player_move q = valid[i];
+        metrics_root(Metrics, q, plays[i], score(i));
+        if (halve && !root_halving_alive(halving, i)) { continue; }
+        if (score(i) > bestScore) {
+            bestScore = score(i);
+            bestPlays = plays[i];
+            best = q;
+        }
+    }
+
+    Metrics.playouts = played;
+    Metrics.seconds = chrono::duration<r64>(chrono::steady_clock::now() - start).count();
+    Metrics.move = best;
+    Metrics.score = bestScore;
+    Metrics.share = r64(bestPlays) / played;
+    metrics_report();
+    return best;
+}
+
+
+typedef struct {
+    u64 parent;
+    r64 wins;
+    u32 rounds;
+    u32 prior_wins;
+    u32 prior_rounds;
+} monte_node;
+
+
+// most a shared table entry may weigh against the current search
+#define TT_PRIOR_CAP 1000
+
+
+static
+monte_node
+monte_new_node(u64 parent, u64 key) {
+    monte_node node = {.parent=parent, .wins=0, .rounds=1};
+    u32 wins, rounds;
+    if (tt_read(SharedTable, key, &wins, &rounds) && rounds) {
+        if (rounds > TT_PRIOR_CAP) {
+            wins = u64(wins) * TT_PRIOR_CAP / rounds;
+            rounds = TT_PRIOR_CAP;
+        }
+        node.prior_wins = wins;
+        node.prior_rounds = rounds;
+        node.wins += wins;
+        node.rounds += rounds;
+    }
+    return node;
+}
+
+
+static inline
+r64
+uct1(r64 wins, r64 rounds, r64 parent_rounds) {
+    const r64 c = 1.4142135623730951;
+    return wins / rounds + c * std::sqrt(std::log(parent_rounds) / rounds);
+}
+
+
+// All-moves-as-first statistics: how each (from, to, prog) move fared
+// whenever its side played it anywhere later in a playout, tree or dive.
+// Young nodes lean on them, RAVE_EQUIV rounds is where both weigh equally.
+
+#define RAVE_EQUIV 500
+#define AMAF_MOVES (25 * 25 * 5)
+
+
+typedef struct {
+    r64 wins;
+    u32 rounds;
+    u32 stamp;
+} amaf_entry;
+
+
+// stamp counts the playouts recorded, so a playout counts a move once
+typedef struct {
+    vector<amaf_entry> entries;
+    u32 stamp;
+} amaf_table;
+
+
+static inline
+u32
+amaf_index(u8 uid, const player_move& mv) {
+    u32 from = mv.from / 10 * 5 + mv.from % 10;
+    u32 to = mv.to / 10 * 5 + mv.to % 10;
+    return ((uid - 1) * 25 * 25 + from * 25 + to) * 5 + mv.pid;
+}
+
+
+static inline
+r64
+uct_rave(r64 wins, r64 rounds, r64 parent_rounds, const amaf_entry& amaf) {
+    r64 beta = std::sqrt(RAVE_EQUIV / (3 * rounds + RAVE_EQUIV));
+    r64 q = wins / rounds;
+    r64 a = amaf.rounds ? amaf.wins / amaf.rounds : q;
+    return uct1(wins, rounds, parent_rounds) + beta * (a - q);
+}
+
+
+// moves alternate sides from uid; win is for whoever made moves[last]
+static
+void
+amaf_update(vector<amaf_entry>& amaf, u32 stamp, u8 uid, const vector<player_move>& moves, u32 last, r64 win) {
+    r64 result = last % 2 ? 1 - win : win;
+    for (u32 i = 0; i < moves.size(); ++i, uid = 3 - uid, result = 1 - result) {
+        auto& entry = amaf[amaf_index(uid, moves[i])];
+        if (entry.stamp == stamp) { continue; }
+        entry.stamp = stamp;
+        entry.wins += result;
+        entry.rounds += 1;
+    }
+}
+
+
+typedef unordered_map<u64, monte_node> monte_tree;
+
+
+// the move monte_move would play with stats as they are, and below it the
+// most visited reply at each ply
+static
+void
+monte_snapshot(const game_state& root_state, const monte_tree& stats, search_snapshot& s) {
+    s.move = player_pass;
+    s.score = -1;
+    s.visits = 0;
+    s.pv_length = 0;
+    auto state = root_state;
+    move_undo undo;
+    for (u32 ply = 0; ply < SNAPSHOT_PV && !state.ended; ++ply) {
+        player_move next = player_pass;
+        r64 best = -1;
+        u32 most = 0;
+        for (auto& mv : valid_moves(state, state.current_player)) {
+            make_move(state, mv, undo);
+            auto it = stats.find(pack_state(state).v);
+            unmake_move(state, undo);
+            if (it == stats.end() || !it->second.rounds) { continue; }
+            auto& node = it->second;
+            u32 visits = node.rounds - 1 - node.prior_rounds;
+            r64 score = node.wins / node.rounds;
+            if (ply ? visits > most : score > best) {
+                best = score;
+                most = visits;
+                next = mv;
+            }
+        }
+        if (next.v == player_pass.v || (ply && !most)) { break; }
+        if (!ply) {
+            s.move = next;
+            s.score = best;
+            s.visits = most;
+        }
+        s.pv[s.pv_length++] = next;
+        make_move(state, next, undo);
+    }
+}
+
+
+static
+void
+snapshot_write(FILE* out, const search_snapshot& s) {
+    char line[512];
+    snapshot_json(line, sizeof(line), s);
+    flockfile(out);
+    fprintf(out, "%s\n", line);
+    fflush(out);
+    funlockfile(out);
+}
+
+
+// visits, when given, gets the search effort per root move in valid_moves order.
+// A tree, when given, is searched on from what earlier searches left in it
+// and kept; its nodes are not written back to SharedTable, since they
+// would count more than once. So is a halving, when given with RootHalving;
+// it is set up by the caller for the whole budget when a search comes
+// back more than once. So is an AMAF table. A Sliced search is seeded by
+// whoever runs the slices, once.
+static
+player_move
+monte_move(const game_state& root_state, r64 time_limit, r64* best_score, vector<u32>* visits, monte_tree* tree,
+    root_halving* kept_halving = nullptr, amaf_table* kept_amaf = nullptr) {
+    if (root_state.ended) {
+        return player_pass;
+    }
+    chrono::duration<r64> tlimit(time_limit);
+    auto start = chrono::steady_clock::now();
+    Metrics = {.engine="monte"};
+    profile_reset();
+    if (!Sliced) { search_seed(root_state); }
+
+    monte_tree local;
+    monte_tree& stats = tree ? *tree : local;
+    u64 root_id = pack_state(root_state).v;
+    if (!stats.count(root_id)) {
+        stats[root_id] = monte_new_node(0, root_id);
+    }
+
+    amaf_table local_amaf = {};
+    amaf_table& amaf_kept = kept_amaf ? *kept_amaf : local_amaf;
+    if (amaf_kept.entries.empty()) { amaf_kept.entries.resize(2 * AMAF_MOVES); }
+    auto& amaf = amaf_kept.entries;
+    vector<player_move> moves;
+
+    // with RootHalving the root move of a playout comes from the halving,
+    // scored by its node, and the tree search takes over below it
+    auto root_valid = valid_moves(root_state, root_state.current_player);
+    if (root_valid.empty()) { return player_pass; }
+    vector<u64> root_keys;
+    for (auto& mv : root_valid) { root_keys.push_back(pack_state(next_state(root_state, mv)).v); }
+    auto root_score = [&](u32 i) {
+        auto it = stats.find(root_keys[i]);
+        return it == stats.end() || !it->second.rounds ? -1 : it->second.wins / it->second.rounds;
+    };
+    root_halving local_halving = {};
+    root_halving& halving = kept_halving ? *kept_halving : local_halving;
+    u8 halve = RootHalving && root_valid.size() > 1 && (PlayoutLimit || !NodeLimit);
+    if (halve && halving.alive.empty()) { root_halving_init(halving, root_valid.size(), PlayoutLimit ? PlayoutLimit : time_limit); }
+
+    u32 total = 0;
+    auto now = start;
+    auto snapshot_at = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<r64>(SnapshotInterval));
+    while (1) {
+        total += 1;
+        u32 forced = halve ? root_halving_next(halving, PlayoutLimit ? halving.played : chrono::duration<r64>(now - start).count(), root_score) : ~0u;
+        auto parent_state = root_state;
+        u64 parent_id = root_id;
+        player_move selected_move = player_pass;
+        u64 selected_id = parent_id;
+        unordered_set<u64> seen;
+        seen.insert(parent_id);
+        vector<u64> path;
+        path.push_back(parent_id);
+        moves.clear();
+
+        while (!parent_state.ended) {
+            PROFILE_SCOPE(PROFILE_SELECT);
+            auto valid = valid_moves(parent_state, parent_state.current_player);
+            if (valid.empty()) {
+                // lost for the side to move, won for the one that moved here
+                parent_state.ended = true;
+                parent_state.win = 1;
+                break;
+            }
+            r64 bestW = -1e20;
+            u64 bestQ = 0;
+            player_move best_move = player_pass;
+            move_undo undo;
+            // for (auto& mv : valid) {
+            for (u32 vi = 0; vi < valid.size(); ++vi) {
+                if (forced != ~0u && path.size() == 1 && vi != forced) { continue; }
+                auto mv = valid[vi];
+                make_move(parent_state, mv, undo);
+                u64 stateQ = pack_state(parent_state).v;
+                u8 ended = parent_state.ended;
+                unmake_move(parent_state, undo);
+                if (seen.find(stateQ) != seen.end()) { continue; }
+                seen.insert(stateQ);
+                auto it = node_find(stats, stateQ);
+                auto& rave = amaf[amaf_index(parent_state.current_player, mv)];
+                r64 wei = 0;
+                if (it == stats.end()) {
+                    auto node = monte_new_node(parent_id, stateQ);
+                    node_get(stats, stateQ) = node;
+                    wei = uct_rave(node.wins, node.rounds, node_get(stats, parent_id).rounds, rave);
+                }
+                else {
+                    auto node = it->second;
+                    wei = uct_rave(node.wins, node.rounds, node_get(stats, parent_id).rounds, rave);
+                }
+                if (ended) {
+                    wei = 100;
+                }
+                if (wei > bestW) {
+                    bestW = wei;
+                    bestQ = stateQ;
+                    best_move = mv;
+                }
+            }
+            if (best_move.from == player_pass.from) {
+                parent_state.ended = true;
+                parent_state.win = 0;
+                break;
+            }
+            path.push_back(bestQ);
+            moves.push_back(best_move);
+            make_move(parent_state, best_move, undo);
+            u8 value = 0;
+            if (tb_probe(Tablebase, parent_state, &value) && value) {
+                parent_state.ended = true;
+                parent_state.win = tb_is_loss(value);
+                break;
+            }
+            auto& leaf = node_get(stats, bestQ);
+            if (leaf.rounds == 1 + leaf.prior_rounds) {
+                // the dive starts from the parent with this move
+                unmake_move(parent_state, undo);
+                selected_move = best_move;
+                selected_id = bestQ;
+                break;
+            }
+            parent_id = bestQ;
+        }
+
+        auto selected = chrono::steady_clock::now();
+        r64 win = 0;
+        u32 last = moves.size() - 1;
+        if (parent_state.ended) {
+            win = parent_state.win;
+        }
+        else {
+            win = mc_dive(parent_state, selected_move, &moves);
+        }
+        auto scored = chrono::steady_clock::now();
+        if (!moves.empty()) {
+            amaf_update(amaf, ++amaf_kept.stamp, root_state.current_player, moves, last, win);
+        }
+
+        if (path.size() > Metrics.max_depth) {
+            Metrics.max_depth = path.size();
+        }
+
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            PROFILE_SCOPE(PROFILE_BACKUP);
+            auto& node = node_get(stats, *it);
+            node.wins += win;
+            node.rounds += 1;
+            win = 1 - win;
+        }
+
+        auto backed = chrono::steady_clock::now();
+        Metrics.select_seconds += chrono::duration<r64>(selected - now).count();
+        Metrics.leaf_seconds += chrono::duration<r64>(scored - selected).count();
+        Metrics.backup_seconds += chrono::duration<r64>(backed - scored).count();
+        now = backed;
+        if (search_spent(total, stats.size(), now - start, tlimit)) { break; }
+        if (Snapshots && SnapshotInterval > 0 && now >= snapshot_at) {
+            search_snapshot snapshot;
+            monte_snapshot(root_state, stats, snapshot);
+            snapshot.playouts = total;
+            snapshot.seconds = chrono::duration<r64>(now - start).count();
+            snapshot_write(Snapshots, snapshot);
+            snapshot_at = now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<r64>(SnapshotInterval));
+        }
+    }
+    Playouts += total;
+
+    if (!tree) {
+        for (auto& p : stats) {
+            auto& node = p.second;
+            tt_add(SharedTable, p.first, std::lround(node.wins - node.prior_wins), node.rounds - node.prior_rounds - 1);
+        }
+    }
+
+    player_move best = player_pass;
+    r64 bestScore = -1;
+    u32 bestRounds = 0;
+    for (u32 i = 0; i < root_valid.size(); ++i) {
+        auto& mv = root_valid[i];
+        monte_node& node = stats[root_keys[i]];
+        u32 played = node.rounds ? node.rounds - 1 - node.prior_rounds : 0;
+        if (visits) { visits->push_back(played); }
+        if (!node.rounds) { continue; }
+        r64 score = r64(node.wins) / r64(node.rounds);
+        metrics_root(Metrics, mv, played, score);
+        // the halving's last round decides between the moves it kept
+        if (halve && !root_halving_alive(halving, i)) { continue; }
+        if (score > bestScore) {
+            bestScore = score;
+            bestRounds = played;
+            best = mv;
+        }
+    }
+
+    Metrics.playouts = total;
+    Metrics.seconds = chrono::duration<r64>(chrono::steady_clock::now() - start).count();
+    if (!Sliced) { metrics_table(Metrics, stats); }
+    Metrics.move = best;
+    Metrics.score = bestScore;
+    Metrics.share = r64(bestRounds) / total;
+    metrics_report();
+
+    if (best_score) { *best_score = bestScore; }
+    return best;
+}
+
+
+static
+player_move
+monte_move(const game_state& root_state, r64 time_limit, r64* best_score = nullptr, vector<u32>* visits = nullptr) {
+    return monte_move(root_state, time_limit, best_score, visits, nullptr);
+}
+
+
+// Tactics a few plies deep: alpha-beta that knows only won and lost, any
+// other position scores 0. A win n plies from the root scores
+// TACTIC_WIN - n, so shorter wins and longer losses come first.
+#define TACTIC_WIN 1000
+// the tactics take up to this share of the time limit, as nodes at about
+// the rate they search, so the same inputs search the same
+#define TACTIC_SHARE 0.1
+#define TACTIC_NODE_RATE 1000000
+
+
+typedef struct {
+    u64 nodes;
+    u64 node_limit;
+    u8 stopped;
+} tactic_budget;
+
+
+// 0 once the budget stops it, its result then means nothing
+static
+i32
+tactic_search(game_state& state, u32 depth, u32 ply, i32 alpha, i32 beta, tactic_budget& budget) {
+    if (++budget.nodes > budget.node_limit) {
+        budget.stopped = 1;
+        return 0;
+    }
+    if (!depth) { return 0; }
+    auto valid = valid_moves(state, state.current_player);
+    // no move loses here, as in the tablebase
+    if (valid.empty()) { return -(TACTIC_WIN - i32(ply)); }
+    for (auto& mv : valid) {
+        if (is_winning_move(state, mv)) { return TACTIC_WIN - ply - 1; }
+    }
+    if (depth == 1) { return 0; }
+    move_undo undo;
+    for (auto& mv : valid) {
+        make_move(state, mv, undo);
+        i32 score = -tactic_search(state, depth - 1, ply + 1, -beta, -alpha, budget);
+        unmake_move(state, undo);
+        if (budget.stopped) { return 0; }
+        if (score > alpha) {
+            alpha = score;
+            if (alpha >= beta) { break; }
+        }
+    }
+    return alpha;
+}
+
+
+// monte_move checked by tactic_search to depth plies: a forced win is
+// played without a search, and a pick that loses by force gives way to
+// the most visited move that does not. The tactics come out of the same
+// time_limit, deepened a ply at a time while their share of it lasts.
+static
+player_move
+portfolio_move(const game_state& root_state, r64 time_limit, u32 depth) {
+    if (root_state.ended) {
+        return player_pass;
+    }
+    auto start = chrono::steady_clock::now();
+    auto state = root_state;
+    auto valid = valid_moves(state, state.current_player);
+    if (valid.empty() || !depth) { return monte_move(root_state, time_limit); }
+    vector<i32> tactic(valid.size());
+    auto proven = [&](u32 i) { return std::abs(tactic[i]) > TACTIC_WIN / 2; };
+    tactic_budget budget = {.nodes=0, .node_limit=u64(time_limit * TACTIC_SHARE * TACTIC_NODE_RATE), .stopped=0};
+    u32 reached = 0;
+    move_undo undo;
+    for (u32 d = 1; d <= depth && !budget.stopped; ++d) {
+        for (u32 i = 0; i < valid.size(); ++i) {
+            if (proven(i)) { continue; }
+            if (is_winning_move(state, valid[i])) {
+                tactic[i] = TACTIC_WIN - 1;
+                continue;
+            }
+            make_move(state, valid[i], undo);
+            i32 score = -tactic_search(state, d - 1, 1, -TACTIC_WIN, TACTIC_WIN, budget);
+            unmake_move(state, undo);
+            if (budget.stopped) { break; }
+            tactic[i] = score;
+        }
+        if (!budget.stopped) { reached = d; }
+    }
+    u32 best = 0;
+    for (u32 i = 0; i < valid.size(); ++i) {
+        if (tactic[i] > tactic[best]) { best = i; }
+    }
+    auto lost = [&](u32 i) { return tactic[i] < -TACTIC_WIN / 2; };
+    u32 losing = 0;
+    for (u32 i = 0; i < valid.size(); ++i) { losing += lost(i); }
+    auto report = [&](const player_move& mv) {
+        Metrics.tactic_depth = reached;
+        Metrics.tactic_nodes = budget.nodes;
+        Metrics.tactic_losing = losing;
+        Metrics.move = mv;
+        Metrics.seconds = chrono::duration<r64>(chrono::steady_clock::now() - start).count();
+        metrics_report();
+        return mv;
+    };
+    if (tactic[best] > TACTIC_WIN / 2) {
+        Metrics = {.engine="tactics"};
+        profile_reset();
+        Metrics.score = 1;
+        Metrics.share = 1;
+        return report(valid[best]);
+    }
+
+    chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+    vector<u32> visits;
+    Nested = 1;
+    auto mv = monte_move(root_state, std::max(time_limit - elapsed.count(), 0.0), nullptr, &visits);
+    Nested = 0;
+    u32 picked = std::find_if(valid.begin(), valid.end(), [&](auto& q) { return q.v == mv.v; }) - valid.begin();
+    if (picked == valid.size() || !lost(picked)) { return report(mv); }
+    i32 most = -1;
+    for (u32 i = 0; i < valid.size() && i < visits.size(); ++i) {
+        if (lost(i) || i32(visits[i]) <= most) { continue; }
+        most = visits[i];
+        mv = valid[i];
+    }
+    if (most < 0) { return report(mv); }
+    Metrics.tactic_override = 1;
+    Metrics.tactic_replaced = valid[picked];
+    for (u32 i = 0; i < Metrics.root_count; ++i) {
+        if (Metrics.root[i].move.v != mv.v) { continue; }
+        Metrics.score = Metrics.root[i].score;
+        Metrics.share = Metrics.playouts ? r64(Metrics.root[i].visits) / Metrics.playouts : 0;
+    }
+    return report(mv);
+}
+
+
+// PUCT search guided by Network instead of dives. Leaves are gathered
+// NN_BATCH at a time, pending visits steer the selection of a batch away
+// from paths already in it.
+
+#define PUCT_C 1.5
+
+
+typedef struct {
+    r64 wins;
+    u32 rounds;
+    u32 pending;
+    u8 expanded;
+    vector<r32> priors; // of the moves out, in valid_moves order
+} puct_node;
+
+
+typedef struct {
+    game_state state;
+    vector<u64> path;
+    vector<player_move> valid;
+    r64 win;
+    u8 evaluate;
+} puct_leaf;
+
+
+static
+void
+puct_select(unordered_map<u64, puct_node>& tree, const game_state& root_state, puct_leaf& leaf) {
+    PROFILE_SCOPE(PROFILE_SELECT);
+    auto state = root_state;
+    u64 id = pack_state(state).v;
+    unordered_set<u64> seen;
+    seen.insert(id);
+    leaf.path.clear();
+    leaf.path.push_back(id);
+    leaf.evaluate = 0;
+    // win is for the side that moved into the last node of the path
+    for (;;) {
+        if (state.ended) {
+            leaf.win = state.win;
+            return;
+        }
+        u8 value = 0;
+        if (leaf.path.size() > 1 && tb_probe(Tablebase, state, &value) && value) {
+            leaf.win = tb_is_loss(value);
+            return;
+        }
+        auto& node = node_get(tree, id);
+        if (!node.expanded) {
+            leaf.valid = valid_moves(state, state.current_player);
+            if (leaf.valid.empty()) {
+                // no move loses for the side to move
+                leaf.win = 1;
+                return;
+            }
+            leaf.state = state;
+            leaf.evaluate = 1;
+            node.pending += 1;
+            return;
+        }
+        r64 visits = node.rounds + node.pending;
+        r64 explore = PUCT_C * std::sqrt(visits);
+        r64 bestW = -1e20;
+        u64 best_id = 0;
+        u32 best = 0;
+        auto valid = valid_moves(state, state.current_player);
+        move_undo undo;
+        for (u32 i = 0; i < valid.size(); ++i) {
+            make_move(state, valid[i], undo);
+            u64 q = pack_state(state).v;
+            u8 ended = state.ended;
+            unmake_move(state, undo);
+            if (seen.count(q)) { continue; }
+            // a child gets its node once it is a leaf of the path;
+            // pending visits count as losses until the batch comes back
+            auto it = node_find(tree, q);
+            r64 n = it == tree.end() ? 0 : it->second.rounds + it->second.pending;
+            r64 value = n ? it->second.wins / n : 0.5;
+            r64 wei = ended ? 100 : value + explore * node.priors[i] / (1 + n);
+            if (wei > bestW) {
+                bestW = wei;
+                best_id = q;
+                best = i;
+            }
+        }
+        node.pending += 1;
+        if (!best_id) {
+            // every move repeats a position on the path, call it a draw
+            leaf.win = 0.5;
+            return;
+        }
+        make_move(state, valid[best], undo);
+        id = best_id;
+        seen.insert(id);
+        leaf.path.push_back(id);
+    }
+}
+
+
+typedef unordered_map<u64, puct_node> puct_tree;
+
+
+// as monte_snapshot, for a tree of puct_move: the most visited move at
+// every ply, the root's too, since that is the one puct_move plays
+static
+void
+puct_snapshot(const game_state& root_state, const puct_tree& tree, search_snapshot& s) {
+    s.move = player_pass;
+    s.score = -1;
+    s.visits = 0;
+    s.pv_length = 0;
+    auto state = root_state;
+    move_undo undo;
+    for (u32 ply = 0; ply < SNAPSHOT_PV && !state.ended; ++ply) {
+        player_move next = player_pass;
+        r64 score = -1;
+        u32 most = 0;
+        for (auto& mv : valid_moves(state, state.current_player)) {
+            make_move(state, mv, undo);
+            auto it = tree.find(pack_state(state).v);
+            unmake_move(state, undo);
+            if (it == tree.end() || it->second.rounds <= most) { continue; }
+            most = it->second.rounds;
+            score = it->second.wins / it->second.rounds;
+            next = mv;
+        }
+        if (next.v == player_pass.v) { break; }
+        if (!ply) {
+            s.move = next;
+            s.score = score;
+            s.visits = most;
+        }
+        s.pv[s.pv_length++] = next;
+        make_move(state, next, undo);
+    }
+}
+
+
+// visits and a kept tree as for monte_move
+static
+player_move
+puct_move(const game_state& root_state, r64 time_limit, r64* best_score, vector<u32>* visits, puct_tree* kept) {
+    if (root_state.ended) {
+        return player_pass;
+    }
+    chrono::duration<r64> tlimit(time_limit);
+    auto start = chrono::steady_clock::now();
+
+    Metrics = {.engine="puct"};
+    profile_reset();
+
+    puct_tree local;
+    puct_tree& tree = kept ? *kept : local;
+    u64 root_id = pack_state(root_state).v;
+
+    puct_leaf leaves[NN_BATCH];
+    game_state states[NN_BATCH];
+    vector<player_move> valid[NN_BATCH];
+    nn_output out[NN_BATCH];
+    // the root goes to the network on its own first, or every selection
+    // of the first batch would stop at it
+    auto root_valid = valid_moves(root_state, root_state.current_player);
+    if (root_valid.empty()) { return player_pass; }
+    u32 total = 0;
+    if (!tree[root_id].expanded) {
+        states[0] = root_state;
+        valid[0] = root_valid;
+        nn_evaluate(Network, states, valid, 1, out);
+        auto& root = tree[root_id];
+        root.expanded = 1;
+        root.priors.assign(out[0].prior, out[0].prior + root_valid.size());
+        root.wins = 1 - out[0].value;
+        root.rounds = 1;
+        total = 1;
+    }
+    auto now = start;
+    auto snapshot_at = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<r64>(SnapshotInterval));
+    while (1) {
+        u32 count = 0;
+        for (auto& leaf : leaves) {
+            puct_select(tree, root_state, leaf);
+            if (leaf.path.size() > Metrics.max_depth) {
+                Metrics.max_depth = leaf.path.size();
+            }
+            if (leaf.evaluate) {
+                states[count] = leaf.state;
+                valid[count].swap(leaf.valid);
+                ++count;
+            }
+        }
+        auto selected = chrono::steady_clock::now();
+        nn_evaluate(Network, states, valid, count, out);
+        auto scored = chrono::steady_clock::now();
+        u32 k = 0;
+        for (auto& leaf : leaves) {
+            if (leaf.evaluate) {
+                auto& node = tree[leaf.path.back()];
+                if (!node.expanded) {
+                    node.expanded = 1;
+                    node.priors.assign(out[k].prior, out[k].prior + valid[k].size());
+                }
+                leaf.win = 1 - out[k].value;
+                ++k;
+            }
+            r64 win = leaf.win;
+            for (auto it = leaf.path.rbegin(); it != leaf.path.rend(); ++it) {
+                PROFILE_SCOPE(PROFILE_BACKUP);
+                auto& node = node_get(tree, *it);
+                node.wins += win;
+                node.rounds += 1;
+                if (node.pending) { node.pending -= 1; }
+                win = 1 - win;
+            }
+            ++total;
+        }
+
+        auto backed = chrono::steady_clock::now();
+        Metrics.select_seconds += chrono::duration<r64>(selected - now).count();
+        Metrics.leaf_seconds += chrono::duration<r64>(scored - selected).count();
+        Metrics.backup_seconds += chrono::duration<r64>(backed - scored).count();
+        now = backed;
+        if (search_spent(total, tree.size(), now - start, tlimit)) { break; }
+        if (Snapshots && SnapshotInterval > 0 && now >= snapshot_at) {
+            search_snapshot snapshot;
+            puct_snapshot(root_state, tree, snapshot);
+            snapshot.playouts = total;
+            snapshot.seconds = chrono::duration<r64>(now - start).count();
+            snapshot_write(Snapshots, snapshot);
+            snapshot_at = now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<r64>(SnapshotInterval));
+        }
+    }
+    Playouts += total;
+
+    player_move best = player_pass;
+    u32 bestRounds = 0;
+    r64 bestScore = -1;
+    for (u32 i = 0; i < root_valid.size(); ++i) {
+        auto& mv = root_valid[i];
+        auto it = tree.find(pack_state(next_state(root_state, mv)).v);
+        u32 rounds = it == tree.end() ? 0 : it->second.rounds;
+        if (visits) { visits->push_back(rounds); }
+        if (!rounds) { continue; }
+        auto& node = it->second;
+        r64 score = node.wins / node.rounds;
+        metrics_root(Metrics, mv, node.rounds, score);
+        if (node.rounds > bestRounds) {
+            bestRounds = node.rounds;
+            bestScore = score;
+            best = mv;
+        }
+    }
+
+    Metrics.playouts = total;
+    Metrics.seconds = chrono::duration<r64>(chrono::steady_clock::now() - start).count();
+    if (!Sliced) { metrics_table(Metrics, tree); }
+    Metrics.move = best;
+    Metrics.score = bestScore;
+    Metrics.share = r64(bestRounds) / total;
+    metrics_report();
+
+    if (best_score) { *best_score = bestScore; }
+    return best;
+}
+
+
+static
+player_move
+puct_move(const game_state& root_state, r64 time_limit, r64* best_score = nullptr, vector<u32>* visits = nullptr) {
+    return puct_move(root_state, time_limit, best_score, visits, nullptr);
+}
@@ -0,0 +1,613 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "profile.h"
+
+
+typedef int8_t i8;
+typedef int16_t i16;
+typedef int32_t i32;
+typedef int64_t i64;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef float r32;
+typedef double r64;
+
+
+using std::vector;
+
+
+typedef struct __attribute__((packed)) {
+    u8 current_player;
+    u8 board[5][5];
+    u8 progs[5];
+} game_state_data;
+
+
+typedef union __attribute__((packed)) {
+    struct {
+        u8 ver;
+        u8 from;
+        u8 to;
+        u8 pid;
+    };
+    u8 raw[4];
+} player_move_data;
+
+
+typedef union {
+    struct {
+        u8 from;
+        u8 to;
+        u8 pid;
+        u8 _reserved;
+    };
+    u32 v;
+} player_move;
+
+
+const player_move player_pass = {.v=0xffffffff};
+
+
+typedef union {
+    struct {
+        u8 a, b;
+    };
+    u8 v[2];
+} u8x2;
+
+
+typedef struct {
+    u8 current_player;
+    union {
+        u8 board[5][5];
+        u8 pieces[25];
+    };
+    union {
+        u8 progs[5];
+        struct {
+            u8 decked_prog;
+            union {
+                u8 player_progs[2][2];
+                u8x2 pprogs[2];
+                struct {
+                    u8 p1_progs[2];
+                    u8 p2_progs[2];
+                };
+            };
+        };
+    };
+    u8 ended;
+    u8 win;
+} game_state;
+
+
+typedef struct __attribute((packed)) {
+    union {
+        u64 v;
+        struct {
+            u64 _reserved: 4;
+            u64 prog1: 2;
+            u64 prog2: 2;
+            u64 prog3: 2;
+            u64 prog4: 2;
+            u64 prog_fix: 1;
+            u64 player: 1;
+            u64 player1_king: 5;
+            u64 player1_p1: 5;
+            u64 player1_p2: 5;
+            u64 player1_p4: 5;
+            u64 player1_p5: 5;
+            u64 player2_king: 5;
+            u64 player2_p1: 5;
+            u64 player2_p2: 5;
+            u64 player2_p4: 5;
+            u64 player2_p5: 5;
+        };
+    };
+} packed_state;
+
+
+static
+const i8 Progs[][5] = {
+    {-10, -1, 1}, // dagger
+    {-20, 10}, // harpoon
+    {-11, -9, -1, 1}, // jackhammer
+    {-1, 1, 9, 11}, // onion
+    {-11, -9, 9, 11}, // shuriken
+};
+
+
+static inline
+u8
+is_king1(u8 piece) {
+    return piece == 13;
+}
+
+
+static inline
+u8
+is_king2(u8 piece) {
+    return piece == 23;
+}
+
+
+static inline
+u8
+is_king(u8 piece) {
+    return piece % 10 == 3;
+}
+
+
+static inline
+u8
+on_board(i8 pos) {
+    i8 x = pos % 10;
+    i8 y = pos / 10;
+    return !(x < 0 || x > 4 || y < 0 || y > 4);
+}
+
+
+static inline
+const u8x2&
+own_progs(const game_state& state, u8 uid) {
+    return state.pprogs[uid-1];
+}
+
+
+static inline
+u8
+is_own(u8 piece, u8 uid) {
+    return piece / 10 == uid;
+}
+
+
+static inline
+u8
+get_piece(const game_state& state, u8 pos) {
+    i8 x = pos % 10;
+    i8 y = pos / 10;
+    return state.board[y][x];
+}
+
+
+static inline
+void
+set_piece(game_state& state, u8 pos, u8 piece) {
+    i8 x = pos % 10;
+    i8 y = pos / 10;
+    state.board[y][x] = piece;
+}
+
+
+static
+u32
+is_terminal(const game_state& state) {
+    u8 p1 = 0, p2 = 0;
+    for (u32 y = 0; y < 5; ++y) {
+        for (u32 x = 0; x < 5; ++x) {
+            u8 piece = state.board[y][x];
+            if (is_king1(piece)) {
+                if (y == 0 && x == 2) { return 1; }
+                p1 = 1;
+            }
+            else if (is_king2(piece)) {
+                if (y == 4 && x == 2) { return 1; }
+                p2 = 1;
+            }
+        }
+    }
+    return !(p1 && p2);
+}
+
+
+static
+packed_state
+pack_state(const game_state& state) {
+    PROFILE_SCOPE(PROFILE_PACK);
+    // missing pieces read as square 31, so every state packs to a distinct key
+    packed_state packed = {.v=~u64(0) << 14};
+    packed.player = state.current_player - 1;
+    u32 pi1 = 0, pi2 = 0;
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        if (is_own(piece, 1)) {
+            if (is_king(piece)) {
+                packed.player1_king = i;
+            }
+            else {
+                switch (pi1++) {
+                    case 0: packed.player1_p1 = i; break;
+                    case 1: packed.player1_p2 = i; break;
+                    case 2: packed.player1_p4 = i; break;
+                    case 3: packed.player1_p5 = i; break;
+                }
+            }
+        }
+        else {
+            if (is_king(piece)) {
+                packed.player2_king = i;
+            }
+            else {
+                switch (pi2++) {
+                    case 0: packed.player2_p1 = i; break;
+                    case 1: packed.player2_p2 = i; break;
+                    case 2: packed.player2_p4 = i; break;
+                    case 3: packed.player2_p5 = i; break;
+                }
+            }
+        }
+    }
+    u8 progs[4];
+    for (u32 i = 0; i < 4; ++i) {
+        progs[i] = state.progs[i+1];
+    }
+    if (progs[0] > progs[1]) {
+        u8 t = progs[0];
+        progs[0] = progs[1];
+        progs[1] = t;
+    }
+    if (progs[2] > progs[3]) {
+        u8 t = progs[2];
+        progs[2] = progs[3];
+        progs[3] = t;
+    }
+    u8 fix = 0, seen0 = 0;
+    for (u32 i = 0; i < 4; ++i) {
+        u8 pid = progs[i];
+        switch (i) {
+            case 0: packed.prog1 = pid; break;
+            case 1: packed.prog2 = pid; break;
+            case 2: packed.prog3 = pid; break;
+            case 3: packed.prog4 = pid; break;
+        }
+        if (pid == 0) { seen0 = 1; }
+        else if (pid == 4 && seen0) {
+            fix = 1;
+        }
+    }
+    packed.prog_fix = fix;
+    return packed;
+}
+
+
+static
+game_state
+unpack_state(const packed_state& packed) {
+    game_state state = {};
+    state.current_player = packed.player + 1;
+    const u64 squares[2][5] = {
+        {packed.player1_king, packed.player1_p1, packed.player1_p2, packed.player1_p4, packed.player1_p5},
+        {packed.player2_king, packed.player2_p1, packed.player2_p2, packed.player2_p4, packed.player2_p5},
+    };
+    for (u32 uid = 1; uid <= 2; ++uid) {
+        const u8 pieces[5] = {3, 1, 2, 4, 5};
+        for (u32 i = 0; i < 5; ++i) {
+            u8 pos = squares[uid-1][i];
+            if (pos < 25) {
+                state.pieces[pos] = uid * 10 + pieces[i];
+            }
+        }
+    }
+    // hands are sorted, so a 4 truncated to 0 can only be the second card
+    const u64 progs[4] = {packed.prog1, packed.prog2, packed.prog3, packed.prog4};
+    u8 seen = 0;
+    for (u32 i = 0; i < 4; ++i) {
+        u8 pid = progs[i];
+        if (i % 2 && !pid) { pid = 4; }
+        state.progs[i+1] = pid;
+        seen |= 1 << pid;
+    }
+    for (u8 pid = 0; pid < 5; ++pid) {
+        if (!(seen & (1 << pid))) { state.decked_prog = pid; }
+    }
+    state.ended = is_terminal(state);
+    state.win = state.ended;
+    return state;
+}
+
+
+static
+game_state
+next_state(const game_state& state, const player_move& mv) {
+    PROFILE_SCOPE(PROFILE_NEXT_STATE);
+    if (state.ended) { return state; }
+    auto next = state;
+    next.current_player = 3 - state.current_player;
+    u8 uid = state.current_player;
+    u8 piece = get_piece(state, mv.from);
+    // if (!piece) { return next; }
+    // if (!is_own(piece, uid)) { return next; }
+    // if (!on_board(mv.to)) { return next; }
+    // u8 target = get_piece(state, mv.to);
+    // if (is_own(target, uid)) { return next; }
+    // if (!is_own_prog(state, mv.pid, uid)) { return next; }
+    // if (!is_prog_move(mv, uid)) { return next; }
+    set_piece(next, mv.from, 0);
+    set_piece(next, mv.to, piece);
+    next.ended = is_terminal(next);
+    if (next.ended) {
+        next.current_player = state.current_player;
+        next.win = 1;
+    }
+    else {
+        for (u32 i = 0; i < 2; ++i) {
+            u8 pid = state.player_progs[uid-1][i];
+            if (pid == mv.pid) {
+                next.player_progs[uid-1][i] = next.decked_prog;
+                next.decked_prog = pid;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+
+static
+i32
+get_score(const game_state& state, u8 uid) {
+    i32 score = 0;
+
+#if 0
+    fprintf(stderr, "pieces: ");
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        fprintf(stderr, "%02d(%d) ", piece, is_own(piece, uid));
+        score += 10 * (2 * is_own(piece, uid) - 1);
+    }
+    if (state.ended) {
+        score = 100 * (2 * (uid == state.current_player) - 1);
+    }
+    fprintf(stderr, ", score: %d\n", score);
+    score = 0;
+#endif
+
+    if (state.ended) {
+        score = 100 * (2 * (uid == state.current_player) - 1);
+        return score;
+    }
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        score += 10 * (2 * is_own(piece, uid) - 1);
+    }
+    return score;
+}
+
+
+static
+vector<player_move>
+valid_moves(const game_state& state, u8 uid) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
+    vector<player_move> valid;
+    i8 rotate = 3 - 2 * uid;
+    for (u32 y = 0; y < 5; ++y) {
+        for (u32 x = 0; x < 5; ++x) {
+            u8 piece = state.board[y][x];
+            if (!is_own(piece, uid)) { continue; }
+            for (u8 pid : own_progs(state, uid).v) {
+                for (i8 d : Progs[pid]) {
+                    if (!d) { continue; }
+                    u8 from = y * 10 + x;
+                    u8 to = from + d * rotate;
+                    if (!on_board(to)) { continue; }
+                    u8 target = get_piece(state, to);
+                    if (is_own(target, uid)) { continue; }
+                    valid.push_back({.from=from, .to=to, .pid=pid});
+                }
+            }
+        }
+    }
+    return valid;
+}
+
+
+static inline
+u32
+square_bit(u8 pos) {
+    return 1u << (pos / 10 * 5 + pos % 10);
+}
+
+
+static inline
+u8
+king_goal(u8 uid) {
+    return uid == 1 ? 2 : 42;
+}
+
+
+// squares a piece at pos could reach with uid's hand, blockers ignored
+static inline
+u32
+piece_reach(const game_state& state, u8 pos, u8 uid) {
+    u32 mask = 0;
+    i8 rotate = 3 - 2 * uid;
+    for (u8 pid : own_progs(state, uid).v) {
+        for (i8 d : Progs[pid]) {
+            if (!d) { continue; }
+            u8 to = pos + d * rotate;
+            if (!on_board(to)) { continue; }
+            mask |= square_bit(to);
+        }
+    }
+    return mask;
+}
+
+
+static inline
+u8
+is_winning_move(const game_state& state, const player_move& mv) {
+    u8 piece = get_piece(state, mv.from);
+    return is_king(get_piece(state, mv.to)) || (is_king(piece) && mv.to == king_goal(piece / 10));
+}
+
+
+// what make_move changed, for unmake_move to put back
+typedef struct {
+    player_move move;
+    u8 captured;
+    u8 slot; // of the hand the played prog left, 2 when the move ended the game
+    u8 current_player;
+    u8 ended;
+    u8 win;
+} move_undo;
+
+
+// next_state in place, for a game that has not ended. Only from and to
+// change, so the game ends just when is_winning_move says so, without
+// looking over the board again.
+static inline
+void
+make_move(game_state& state, const player_move& mv, move_undo& undo) {
+    PROFILE_SCOPE(PROFILE_NEXT_STATE);
+    u8 uid = state.current_player;
+    u8 piece = get_piece(state, mv.from);
+    undo = {.move=mv, .captured=get_piece(state, mv.to), .slot=2, .current_player=uid, .ended=state.ended, .win=state.win};
+    state.ended = is_winning_move(state, mv);
+    set_piece(state, mv.from, 0);
+    set_piece(state, mv.to, piece);
+    if (state.ended) {
+        state.win = 1;
+        return;
+    }
+    state.current_player = 3 - uid;
+    for (u8 i = 0; i < 2; ++i) {
+        u8 pid = state.player_progs[uid-1][i];
+        if (pid == mv.pid) {
+            state.player_progs[uid-1][i] = state.decked_prog;
+            state.decked_prog = pid;
+            undo.slot = i;
+            break;
+        }
+    }
+}
+
+
+static inline
+void
+unmake_move(game_state& state, const move_undo& undo) {
+    u8 uid = undo.current_player;
+    if (undo.slot < 2) {
+        u8 pid = state.decked_prog;
+        state.decked_prog = state.player_progs[uid-1][undo.slot];
+        state.player_progs[uid-1][undo.slot] = pid;
+    }
+    set_piece(state, undo.move.from, get_piece(state, undo.move.to));
+    set_piece(state, undo.move.to, undo.captured);
+    state.current_player = uid;
+    state.ended = undo.ended;
+    state.win = undo.win;
+}
+
+
+// what the side not to move could do next ply, enough to tell which of
+// our moves hand it the game
+typedef struct {
+    u8 count;
+    u8 pos[5];
+    u32 reach[5];
+    u8 king;
+    u8 own_king;
+    u8 goal_blocked;
+} threat_map;
+
+
+static
+void
+threat_map_init(threat_map& threats, const game_state& state) {
+    u8 uid = state.current_player;
+    u8 opp = 3 - uid;
+    threats = {.king=0xff, .own_king=0xff};
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        u8 pos = i / 5 * 10 + i % 5;
+        if (is_own(piece, opp)) {
+            if (is_king(piece)) { threats.king = threats.count; }
+            threats.pos[threats.count] = pos;
+            threats.reach[threats.count] = piece_reach(state, pos, opp);
+            ++threats.count;
+        }
+        else if (is_king(piece)) {
+            threats.own_king = pos;
+        }
+    }
+    u8 goal = get_piece(state, king_goal(opp));
+    threats.goal_blocked = is_own(goal, opp);
+}
+
+
+// whether after mv the opponent can take our king or walk its own home
+static
+u8
+is_losing_move(const threat_map& threats, const game_state& state, const player_move& mv) {
+    u8 opp = 3 - state.current_player;
+    u8 king = is_king(get_piece(state, mv.from)) ? mv.to : threats.own_king;
+    u32 reach = 0;
+    for (u32 i = 0; i < threats.count; ++i) {
+        if (threats.pos[i] == mv.to) { continue; }
+        reach |= threats.reach[i];
+    }
+    if (reach & square_bit(king)) { return 1; }
+    if (threats.king == 0xff || threats.pos[threats.king] == mv.to) { return 0; }
+    u8 goal = king_goal(opp);
+    u8 blocked = threats.goal_blocked && mv.to != goal;
+    return !blocked && (threats.reach[threats.king] & square_bit(goal));
+}
+
+
+#define EVAL_PAWN 1.0
+#define EVAL_KING_STEP 0.3
+#define EVAL_MOBILITY 0.05
+#define EVAL_SCALE 0.5
+
+
+// win probability for uid from material, how far each king is from its
+// goal and how many moves each side has with its current hand
+static
+r64
+static_eval(const game_state& state, u8 uid) {
+    if (state.ended) {
+        return state.current_player == uid;
+    }
+    u8 side = state.current_player;
+    u32 own[2] = {}, kings[2] = {};
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        own[piece / 10 - 1] |= 1u << i;
+        if (is_king(piece)) { kings[piece / 10 - 1] = 1u << i; }
+    }
+    r64 score[2] = {};
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        u8 owner = piece / 10;
+        u8 pos = i / 5 * 10 + i % 5;
+        u32 reach = piece_reach(state, pos, owner) & ~own[owner-1];
+        u32 wins = reach & kings[2-owner];
+        score[owner-1] += EVAL_MOBILITY * __builtin_popcount(reach);
+        if (is_king(piece)) {
+            u8 goal = king_goal(owner);
+            i32 dy = i32(pos / 10) - goal / 10;
+            i32 dx = i32(pos % 10) - goal % 10;
+            score[owner-1] -= EVAL_KING_STEP * (std::abs(dy) + std::abs(dx));
+            wins |= reach & square_bit(goal);
+        }
+        else {
+            score[owner-1] += EVAL_PAWN;
+        }
+        // the side to move wins outright
+        if (owner == side && wins) {
+            return side == uid;
+        }
+    }
+    r64 x = EVAL_SCALE * (score[uid-1] - score[2-uid]);
+    return 0.5 + 0.5 * x / (1 + std::abs(x));
+}
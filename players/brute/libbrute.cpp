@@ -0,0 +1,269 @@
+// c++ -std=c++20 -O3 -fPIC -shared -pthread -o libbrute.so libbrute.cpp
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "engine.h"
+#include "analysis.h"
+#include "book.h"
+#include "libbrute.h"
+
+
+static_assert(sizeof(game_state_data) == 31);
+static_assert(sizeof(brute_move_stats) == 12);
+
+
+// a bigger tree starts over, as a server session does
+#define LIB_TREE_NODES 4000000
+
+
+struct brute_engine {
+    opening_book book;
+    u32 dive_limit;
+    game_state state;
+    u8 placed;
+    vector<monte_tree> trees; // one per search thread
+    player_move best;
+    vector<brute_move_stats> stats;
+    // search threads beyond the caller's, kept from search to search; a
+    // new job wakes them, the last one done wakes the caller
+    vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::function<void(u32)> job;
+    u32 job_threads;
+    u32 running;
+    u64 generation;
+    u8 closing;
+};
+
+
+static
+void
+lib_worker(brute_engine* e, u32 t) {
+    u64 seen = 0;
+    std::unique_lock<std::mutex> guard(e->lock);
+    for (;;) {
+        e->wake.wait(guard, [&]() { return e->closing || e->generation != seen; });
+        if (e->closing) { return; }
+        seen = e->generation;
+        if (t >= e->job_threads) { continue; }
+        guard.unlock();
+        e->job(t);
+        guard.lock();
+        if (!--e->running) { e->idle.notify_all(); }
+    }
+}
+
+
+// job(t) for t in 0..threads, 0 on the calling thread; returns once all are done
+static
+void
+lib_run(brute_engine* e, u32 threads, std::function<void(u32)> job) {
+    while (e->workers.size() + 1 < threads) {
+        e->workers.emplace_back(lib_worker, e, u32(e->workers.size() + 1));
+    }
+    {
+        std::lock_guard<std::mutex> guard(e->lock);
+        e->job = std::move(job);
+        e->job_threads = threads;
+        e->running = threads - 1;
+        e->generation += 1;
+    }
+    e->wake.notify_all();
+    e->job(0);
+    std::unique_lock<std::mutex> guard(e->lock);
+    e->idle.wait(guard, [&]() { return !e->running; });
+}
+
+
+static
+u8
+lib_valid_state(const game_state_data& data) {
+    if (data.current_player != 1 && data.current_player != 2) { return 0; }
+    for (u32 y = 0; y < 5; ++y) {
+        for (u32 x = 0; x < 5; ++x) {
+            u8 piece = data.board[y][x];
+            if (piece && !(piece >= 11 && piece <= 15) && !(piece >= 21 && piece <= 25)) { return 0; }
+        }
+    }
+    u32 seen = 0;
+    for (u32 i = 0; i < 5; ++i) {
+        if (data.progs[i] > 4 || (seen & (1 << data.progs[i]))) { return 0; }
+        seen |= 1 << data.progs[i];
+    }
+    return 1;
+}
+
+
+static
+brute_move_stats
+lib_move_stats(const player_move& mv, u32 visits, r64 score) {
+    return {.ver=1, .from=mv.from, .to=mv.to, .pid=mv.pid, .visits=visits, .score=r32(score)};
+}
+
+
+// every tree's rounds on each root move summed, the move picked as
+// monte_move picks it
+static
+void
+lib_root_stats(brute_engine& e) {
+    auto& root = e.state;
+    r64 best_score = -1;
+    for (auto& mv : valid_moves(root, root.current_player)) {
+        u64 key = pack_state(next_state(root, mv)).v;
+        r64 wins = 0;
+        u32 rounds = 0, visits = 0;
+        for (auto& tree : e.trees) {
+            auto it = tree.find(key);
+            if (it == tree.end()) { continue; }
+            auto& node = it->second;
+            wins += node.wins;
+            rounds += node.rounds;
+            visits += node.rounds ? node.rounds - 1 - node.prior_rounds : 0;
+        }
+        r64 score = rounds ? wins / rounds : 0;
+        e.stats.push_back(lib_move_stats(mv, visits, score));
+        if (rounds && score > best_score) {
+            best_score = score;
+            e.best = mv;
+        }
+    }
+}
+
+
+extern "C" {
+
+
+brute_engine*
+brute_create(const brute_options* options) {
+    Verbose = 0;
+    auto e = new brute_engine();
+    e->best = player_pass;
+    e->dive_limit = options ? options->dive_limit : 0;
+    if (!options) { return e; }
+    if ((options->book && !book_open(e->book, options->book)) ||
+        (options->tablebase && !Tablebase.data && !tb_open(Tablebase, options->tablebase)) ||
+        (options->shared_table && !SharedTable.header && !tt_open(SharedTable, options->shared_table, 64)) ||
+        (options->network && !Network.header && !nn_open(Network, options->network))) {
+        brute_destroy(e);
+        return nullptr;
+    }
+    return e;
+}
+
+
+void
+brute_destroy(brute_engine* e) {
+    if (!e) { return; }
+    {
+        std::lock_guard<std::mutex> guard(e->lock);
+        e->closing = 1;
+    }
+    e->wake.notify_all();
+    for (auto& w : e->workers) { w.join(); }
+    book_close(e->book);
+    delete e;
+}
+
+
+int
+brute_set_position(brute_engine* e, const uint8_t state[31]) {
+    game_state_data data;
+    memcpy(&data, state, sizeof(data));
+    if (!lib_valid_state(data)) { return 0; }
+    e->state = state_from_data(data);
+    e->placed = 1;
+    e->best = player_pass;
+    e->stats.clear();
+    return 1;
+}
+
+
+uint32_t
+brute_search(brute_engine* e, double seconds, uint32_t playouts, uint32_t nodes, uint32_t threads) {
+    e->best = player_pass;
+    e->stats.clear();
+    if (!e->placed || e->state.ended) { return 0; }
+    auto& state = e->state;
+    player_move mv;
+    if (book_probe(e->book, state, &mv)) {
+        auto entry = book_find(e->book.entries, e->book.count, pack_state(state).v);
+        e->best = mv;
+        e->stats.push_back(lib_move_stats(mv, 0, entry->score / 255.0));
+        return 0;
+    }
+    r64 score = 0;
+    if (tb_probe_move(Tablebase, state, &mv, &score)) {
+        e->best = mv;
+        e->stats.push_back(lib_move_stats(mv, 0, score));
+        return 0;
+    }
+
+    u32 total = 0;
+    if (Network.header) {
+        // the network's search keeps no tree and runs on this thread
+        DiveLimit = e->dive_limit;
+        PlayoutLimit = playouts;
+        NodeLimit = nodes;
+        vector<u32> visits;
+        u64 before = Playouts;
+        e->best = puct_move(state, seconds, &score, &visits);
+        auto valid = valid_moves(state, state.current_player);
+        for (u32 i = 0; i < valid.size() && i < visits.size(); ++i) {
+            e->stats.push_back(lib_move_stats(valid[i], visits[i], valid[i].v == e->best.v ? score : 0));
+        }
+        total = Playouts - before;
+    }
+    else {
+        threads = std::max<u32>(threads, 1);
+        if (e->trees.size() < threads) { e->trees.resize(threads); }
+        // a tree from another game is no use here
+        u64 root_key = pack_state(state).v;
+        for (auto& tree : e->trees) {
+            if (!tree.count(root_key) || tree.size() > LIB_TREE_NODES) { tree.clear(); }
+        }
+        vector<u64> played(threads);
+        lib_run(e, threads, [&](u32 t) {
+            DiveLimit = e->dive_limit;
+            PlayoutLimit = playouts ? std::max<u32>((playouts + threads - 1 - t) / threads, 1) : 0;
+            NodeLimit = nodes;
+            u64 before = Playouts;
+            monte_move(state, seconds, nullptr, nullptr, &e->trees[t]);
+            played[t] = Playouts - before;
+        });
+        lib_root_stats(*e);
+        for (auto n : played) { total += n; }
+    }
+    std::stable_sort(e->stats.begin(), e->stats.end(), [](auto& a, auto& b) { return a.visits > b.visits; });
+    return total;
+}
+
+
+int
+brute_best_move(const brute_engine* e, uint8_t move[4]) {
+    if (e->best.v == player_pass.v) { return 0; }
+    player_move_data res = {.ver=1, .from=e->best.from, .to=e->best.to, .pid=e->best.pid};
+    memcpy(move, res.raw, sizeof(res.raw));
+    return 1;
+}
+
+
+uint32_t
+brute_root_stats(const brute_engine* e, brute_move_stats* stats, uint32_t count) {
+    u32 n = std::min<u32>(count, e->stats.size());
+    std::copy(e->stats.begin(), e->stats.begin() + n, stats);
+    return e->stats.size();
+}
+
+
+void
+brute_release(brute_engine* e) {
+    e->trees.clear();
+    e->trees.shrink_to_fit();
+}
+
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+
+// The brute engine in process, with a C ABI (make libbrute.so; pybrute.py
+// is the Python binding). An engine keeps its search trees from search to
+// search until brute_release, or until a search finds its position missing
+// from them or them too big; the tablebase, network and shared table are
+// per process and opened by the first engine that names them.
+//
+// States are the 31 bytes brute reads on stdin, moves the 4 it writes.
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct brute_engine brute_engine;
+
+
+typedef struct {
+    const char* tablebase; // paths, each may be null
+    const char* book;
+    const char* shared_table;
+    const char* network;
+    uint32_t dive_limit; // dive plies before a static score, 0 plays out
+} brute_options;
+
+
+typedef struct __attribute__((packed)) {
+    uint8_t ver; // 0 for no move
+    uint8_t from;
+    uint8_t to;
+    uint8_t pid;
+    uint32_t visits;
+    float score; // win rate for the side to move
+} brute_move_stats;
+
+
+// null when a file named in options does not open
+brute_engine* brute_create(const brute_options* options);
+void brute_destroy(brute_engine* engine);
+
+// 0 for a malformed state
+int brute_set_position(brute_engine* engine, const uint8_t state[31]);
+
+// playouts or nodes, when not 0, stand in for seconds; a book or tablebase
+// move takes no search. Each thread searches a tree of its own, playouts
+// are split between them; the threads stay with the engine for its next
+// search. Returns the playouts run.
+uint32_t brute_search(brute_engine* engine, double seconds, uint32_t playouts, uint32_t nodes, uint32_t threads);
+
+// the move of the last search, 0 when there is none
+int brute_best_move(const brute_engine* engine, uint8_t move[4]);
+
+// root moves of the last search, most visited first; returns how many
+// there are, of which at most count are written
+uint32_t brute_root_stats(const brute_engine* engine, brute_move_stats* stats, uint32_t count);
+
+// drops the trees kept for later searches
+void brute_release(brute_engine* engine);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,418 @@
+// cc -std=c++20 -lc++ -O3 -o load load.cpp
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game.h"
+#include "selfplay.h"
+
+
+namespace chrono = std::chrono;
+using std::vector;
+
+
+// Load generator for the move service, player.py or brute -L: positions
+// of a corpus POSTed to the endpoint at a rate, over up to -C keep-alive
+// connections from one epoll loop. Arrivals are Poisson and a request's
+// latency counts from its arrival, not from when a connection was free
+// to send it, so a slow server is not hidden by a slow client.
+//
+// The corpus is a self-play file, or game_state_data records as brute -a
+// reads them. With -P the server's CPU time, children included, is
+// divided by the moves answered. Reports are appended to -o as JSON lines
+// labelled with -m, one per run, to be compared across server modes.
+
+
+typedef struct {
+    int fd; // -1 when closed
+    u8 connected;
+    u8 busy;
+    r64 arrival; // of the request in flight
+    std::string out;
+    size_t sent;
+    std::string in;
+} load_connection;
+
+
+typedef struct {
+    u32 requests;
+    u32 ok;
+    u32 errors;
+    u32 timeouts;
+    vector<r64> latencies;
+} load_results;
+
+
+static
+std::string
+state_json(const game_state& state, u32 time_limit) {
+    std::string json = "{\"currentPlayer\":" + std::to_string(state.current_player) + ",\"board\":[";
+    for (u32 i = 0; i < 25; ++i) {
+        if (i) { json += ","; }
+        json += std::to_string(state.pieces[i]);
+    }
+    json += "],\"progs\":[";
+    for (u32 i = 0; i < 5; ++i) {
+        if (i) { json += ","; }
+        json += std::to_string(state.progs[i]);
+    }
+    json += "]";
+    if (time_limit) { json += ",\"timeLimit\":" + std::to_string(time_limit); }
+    return json + "}";
+}
+
+
+// every position still to play in path, as request bodies
+static
+u8
+load_corpus(const char* path, u32 time_limit, vector<std::string>& bodies) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    char magic[4] = {};
+    fread(magic, 1, 4, f);
+    fseek(f, 0, SEEK_SET);
+    if (!memcmp(magic, SP_MAGIC, 4)) {
+        fclose(f);
+        sp_file file;
+        if (!sp_open(file, path)) { return 0; }
+        sp_cursor cursor = {};
+        sp_record record;
+        const u8* visits;
+        while (sp_next(file, cursor, &record, &visits)) {
+            auto state = unpack_state({.v=record.state});
+            if (!is_terminal(state)) { bodies.push_back(state_json(state, time_limit)); }
+        }
+        sp_close(file);
+    }
+    else {
+        for (game_state_data data; fread(&data, sizeof(data), 1, f) == 1; ) {
+            game_state state = {};
+            state.current_player = data.current_player;
+            memcpy(state.pieces, data.board, sizeof(state.pieces));
+            memcpy(state.progs, data.progs, sizeof(state.progs));
+            if (!is_terminal(state)) { bodies.push_back(state_json(state, time_limit)); }
+        }
+        fclose(f);
+    }
+    if (bodies.empty()) {
+        fprintf(stderr, "%s: no positions to play\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+
+// user, system and waited-for children's CPU seconds of pid; -1 when unknown
+static
+r64
+process_cpu(int pid) {
+    if (!pid) { return -1; }
+    char path[64], line[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* f = fopen(path, "r");
+    if (!f) { return -1; }
+    size_t n = fread(line, 1, sizeof(line) - 1, f);
+    fclose(f);
+    line[n] = 0;
+    // fields 14 to 17 counted from the one after the command's closing paren, field 3
+    const char* p = strrchr(line, ')');
+    if (!p) { return -1; }
+    unsigned long long ticks[4];
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %llu %llu",
+        &ticks[0], &ticks[1], &ticks[2], &ticks[3]) != 4) {
+        return -1;
+    }
+    return r64(ticks[0] + ticks[1] + ticks[2] + ticks[3]) / sysconf(_SC_CLK_TCK);
+}
+
+
+static
+void
+load_close(int epoll, load_connection& c) {
+    if (c.fd >= 0) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+    }
+    c.fd = -1;
+    c.connected = 0;
+    c.busy = 0;
+    c.out.clear();
+    c.sent = 0;
+    c.in.clear();
+}
+
+
+static
+u8
+load_connect(int epoll, const addrinfo* addr, load_connection& c, u32 id) {
+    c.fd = socket(addr->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd < 0) { return 0; }
+    if (connect(c.fd, addr->ai_addr, addr->ai_addrlen) && errno != EINPROGRESS) {
+        close(c.fd);
+        c.fd = -1;
+        return 0;
+    }
+    epoll_event ev = {.events=EPOLLIN | EPOLLOUT, .data={.u32=id}};
+    epoll_ctl(epoll, EPOLL_CTL_ADD, c.fd, &ev);
+    return 1;
+}
+
+
+static
+u8
+load_flush(int epoll, load_connection& c, u32 id) {
+    while (c.sent < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+        if (n < 0) { return errno == EAGAIN || errno == EWOULDBLOCK; }
+        c.sent += n;
+    }
+    epoll_event ev = {.events=EPOLLIN, .data={.u32=id}};
+    epoll_ctl(epoll, EPOLL_CTL_MOD, c.fd, &ev);
+    return 1;
+}
+
+
+// the response at the front of c.in: its status, 0 while incomplete;
+// at_end takes a response without Content-Length as ending with the stream
+static
+u32
+load_response(load_connection& c, u8 at_end, u8* close) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) { return 0; }
+    std::string head = c.in.substr(0, end);
+    for (auto& ch : head) {
+        if (ch >= 'A' && ch <= 'Z') { ch += 'a' - 'A'; }
+    }
+    u32 status = 0;
+    if (sscanf(head.c_str(), "http/%*u.%*u %u", &status) != 1) { return 999; }
+    size_t p = head.find("\ncontent-length:");
+    if (p == std::string::npos && !at_end) { return 0; }
+    size_t length = p == std::string::npos ? c.in.size() - end - 4 : strtoul(head.c_str() + p + 16, nullptr, 10);
+    if (c.in.size() < end + 4 + length) { return 0; }
+    *close = head.find("\nconnection: close") != std::string::npos || !head.compare(0, 9, "http/1.0 ");
+    c.in.erase(0, end + 4 + length);
+    return status;
+}
+
+
+static
+r64
+percentile(const vector<r64>& sorted, r64 q) {
+    if (sorted.empty()) { return 0; }
+    return sorted[std::min<size_t>(sorted.size() - 1, size_t(q * sorted.size()))];
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s -c corpus [-u host:port] [-r rate] [-n requests] [-C connections] [-T timeout] [-l ms] [-P pid] [-m label] [-o report]\n", name);
+    fprintf(stderr, "  -c  self-play file or game_state_data records, positions sent in turn\n");
+    fprintf(stderr, "  -u  move service (default localhost:8001)\n");
+    fprintf(stderr, "  -r  requests per second, Poisson arrivals; 0 sends as fast as answered (default 1)\n");
+    fprintf(stderr, "  -n  requests to send (default 100)\n");
+    fprintf(stderr, "  -C  most connections at once (default 16)\n");
+    fprintf(stderr, "  -T  seconds before a request counts as timed out (default 10)\n");
+    fprintf(stderr, "  -l  timeLimit in ms sent with each request, for brute -L\n");
+    fprintf(stderr, "  -P  server pid, for CPU per move\n");
+    fprintf(stderr, "  -m  label of the run in the report\n");
+    fprintf(stderr, "  -o  file the report is appended to as a JSON line\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* corpus = nullptr;
+    std::string host = "localhost", port = "8001";
+    r64 rate = 1;
+    u32 requests = 100;
+    u32 connections = 16;
+    r64 timeout = 10;
+    u32 time_limit = 0;
+    int pid = 0;
+    const char* label = "";
+    const char* report = nullptr;
+    for (int opt; (opt = getopt(argc, argv, "c:u:r:n:C:T:l:P:m:o:h")) != -1; ) {
+        switch (opt) {
+            case 'c': corpus = optarg; break;
+            case 'u': {
+                std::string u = optarg;
+                size_t colon = u.rfind(':');
+                if (colon == std::string::npos) { host = u; }
+                else { host = u.substr(0, colon); port = u.substr(colon + 1); }
+                break;
+            }
+            case 'r': rate = atof(optarg); break;
+            case 'n': requests = atoi(optarg); break;
+            case 'C': connections = std::max(atoi(optarg), 1); break;
+            case 'T': timeout = atof(optarg); break;
+            case 'l': time_limit = atoi(optarg); break;
+            case 'P': pid = atoi(optarg); break;
+            case 'm': label = optarg; break;
+            case 'o': report = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    vector<std::string> bodies;
+    if (!corpus) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!load_corpus(corpus, time_limit, bodies)) { return 1; }
+    addrinfo hints = {.ai_socktype=SOCK_STREAM}, *addr;
+    if (int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &addr)) {
+        fprintf(stderr, "%s: %s\n", host.c_str(), gai_strerror(err));
+        return 1;
+    }
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    vector<load_connection> pool(connections);
+    for (auto& c : pool) { c.fd = -1; }
+    load_results results = {};
+    std::deque<r64> waiting; // arrivals not yet sent
+    std::default_random_engine rng(1);
+    std::exponential_distribution<r64> gap(rate > 0 ? rate : 1);
+    u32 issued = 0, sent = 0, inflight = 0;
+    r64 next_arrival = 0;
+    r64 cpu_start = process_cpu(pid);
+    auto start = chrono::steady_clock::now();
+    auto clock = [&]() { return chrono::duration<r64>(chrono::steady_clock::now() - start).count(); };
+    // status 0 is a request the connection failed
+    auto finish = [&](load_connection& c, u32 status) {
+        results.latencies.push_back(clock() - c.arrival);
+        if (status >= 200 && status < 300) { ++results.ok; }
+        else { ++results.errors; }
+        c.busy = 0;
+        --inflight;
+    };
+    fprintf(stderr, "%zu positions, %u requests at %g/s to %s:%s\n", bodies.size(), requests, rate, host.c_str(), port.c_str());
+
+    while (results.ok + results.errors + results.timeouts < requests) {
+        r64 now = clock();
+        // closed loop: a request arrives whenever a connection is free
+        while (issued < requests && (rate > 0 ? next_arrival <= now : issued - sent + inflight < connections)) {
+            waiting.push_back(rate > 0 ? next_arrival : now);
+            ++issued;
+            next_arrival += gap(rng);
+        }
+        for (u32 id = 0; id < pool.size() && !waiting.empty(); ++id) {
+            auto& c = pool[id];
+            if (c.busy) { continue; }
+            c.arrival = waiting.front();
+            waiting.pop_front();
+            ++sent;
+            ++inflight;
+            if (c.fd < 0 && !load_connect(epoll, addr, c, id)) {
+                finish(c, 0);
+                continue;
+            }
+            auto& body = bodies[(sent - 1) % bodies.size()];
+            c.out = "POST /hackerchess/move HTTP/1.1\r\nHost: " + host + "\r\nContent-Type: application/json\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+            c.sent = 0;
+            c.busy = 1;
+            if (c.connected && !load_flush(epoll, c, id)) {
+                finish(c, 0);
+                load_close(epoll, c);
+            }
+        }
+        // a request that outlived the timeout is given up with its connection
+        r64 wake = rate > 0 && issued < requests ? next_arrival : now + 1;
+        for (auto& c : pool) {
+            if (!c.busy) { continue; }
+            if (now - c.arrival >= timeout) {
+                load_close(epoll, c);
+                ++results.timeouts;
+                --inflight;
+                continue;
+            }
+            wake = std::min(wake, c.arrival + timeout);
+        }
+        epoll_event events[64];
+        int n = epoll_wait(epoll, events, 64, std::max(0, int(std::ceil((wake - clock()) * 1000))));
+        for (int i = 0; i < n; ++i) {
+            u32 id = events[i].data.u32;
+            auto& c = pool[id];
+            if (c.fd < 0) { continue; }
+            u8 failed = events[i].events & EPOLLERR;
+            if (!failed && !c.connected && (events[i].events & EPOLLOUT)) {
+                c.connected = 1;
+                if (c.busy) { failed = !load_flush(epoll, c, id); }
+            }
+            else if (!failed && (events[i].events & EPOLLOUT)) {
+                failed = !load_flush(epoll, c, id);
+            }
+            u8 ended = 0;
+            if (!failed && (events[i].events & (EPOLLIN | EPOLLHUP))) {
+                char buffer[0x1000];
+                for (;;) {
+                    ssize_t k = recv(c.fd, buffer, sizeof(buffer), 0);
+                    if (k > 0) {
+                        c.in.append(buffer, k);
+                        continue;
+                    }
+                    if (k == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) { ended = 1; }
+                    break;
+                }
+            }
+            u8 closing = 0;
+            if (!failed && c.busy) {
+                if (u32 status = load_response(c, ended, &closing)) {
+                    finish(c, status);
+                }
+            }
+            if (failed || ended || closing) {
+                if (c.busy) { finish(c, 0); }
+                load_close(epoll, c);
+            }
+        }
+    }
+    r64 seconds = clock();
+    r64 cpu_end = process_cpu(pid);
+    freeaddrinfo(addr);
+
+    auto& l = results.latencies;
+    std::sort(l.begin(), l.end());
+    r64 mean = 0;
+    for (auto x : l) { mean += x; }
+    mean = l.empty() ? 0 : mean / l.size();
+    r64 cpu = cpu_start >= 0 && cpu_end >= 0 && results.ok ? (cpu_end - cpu_start) / results.ok : -1;
+    printf("%s%s%u requests in %.2f s, %.2f/s answered, %u ok, %u errors, %u timeouts\n", label, *label ? ": " : "",
+        requests, seconds, results.ok / seconds, results.ok, results.errors, results.timeouts);
+    printf("latency ms: mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p999 %.1f, max %.1f\n", 1e3 * mean,
+        1e3 * percentile(l, 0.5), 1e3 * percentile(l, 0.9), 1e3 * percentile(l, 0.99), 1e3 * percentile(l, 0.999),
+        1e3 * (l.empty() ? 0 : l.back()));
+    if (cpu >= 0) { printf("server cpu: %.3f s per move\n", cpu); }
+    if (report) {
+        FILE* f = fopen(report, "a");
+        if (!f) {
+            perror(report);
+            return 1;
+        }
+        fprintf(f, "{\"label\":\"%s\",\"rate\":%g,\"connections\":%u,\"time_limit\":%u,\"requests\":%u,\"seconds\":%.3f,"
+            "\"throughput\":%.3f,\"ok\":%u,\"errors\":%u,\"timeouts\":%u,"
+            "\"latency_ms\":{\"mean\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f},"
+            "\"cpu_per_move\":%.4f}\n",
+            label, rate, connections, time_limit, requests, seconds, results.ok / seconds,
+            results.ok, results.errors, results.timeouts, 1e3 * mean, 1e3 * percentile(l, 0.5), 1e3 * percentile(l, 0.9),
+            1e3 * percentile(l, 0.99), 1e3 * percentile(l, 0.999), 1e3 * (l.empty() ? 0 : l.back()), cpu);
+        fclose(f);
+    }
+    return results.errors || results.timeouts;
+}
@@ -0,0 +1,297 @@
+// cc -std=c++20 -lc++ -O3 -pthread -o match match.cpp
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "engine.h"
+
+
+using std::vector;
+
+
+// An engine is a name with optional settings, e.g. monte:k=12:t=0.5
+//   t  seconds per move, overrides -t
+//   n  playouts per move, overrides -n
+//   x  tree nodes per move
+//   k  dive plies before static_eval, monte and shallow
+//   d  depth, brute
+//   h  1 picks the root move by sequential halving, shallow and monte
+//   v  tactic plies checking monte's pick, see portfolio_move
+typedef struct {
+    const char* spec;
+    char name[16];
+    r64 time_limit;
+    u32 playouts;
+    u32 nodes;
+    u32 dive_limit;
+    u32 depth;
+    u8 halving;
+    u32 tactic_depth;
+} engine_config;
+
+
+typedef struct {
+    u64 playouts;
+    r64 seconds;
+    u32 moves;
+} engine_stats;
+
+
+typedef struct {
+    r64 elo0;
+    r64 elo1;
+    r64 alpha;
+    r64 beta;
+} sprt_config;
+
+
+static
+u8
+parse_engine(engine_config& e, const char* spec, r64 time_limit, u32 playouts) {
+    e = {.spec=spec, .time_limit=time_limit, .playouts=playouts, .depth=3};
+    const char* p = strchr(spec, ':');
+    size_t n = p ? size_t(p - spec) : strlen(spec);
+    if (n >= sizeof(e.name)) { return 0; }
+    memcpy(e.name, spec, n);
+    e.name[n] = 0;
+    if (strcmp(e.name, "random") && strcmp(e.name, "brute") && strcmp(e.name, "shallow") &&
+        strcmp(e.name, "monte") && strcmp(e.name, "puct")) {
+        return 0;
+    }
+    while (p) {
+        char key = p[1];
+        if (!key || p[2] != '=') { return 0; }
+        const char* value = p + 3;
+        switch (key) {
+            case 't': e.time_limit = atof(value); break;
+            case 'n': e.playouts = atoi(value); break;
+            case 'x': e.nodes = atoi(value); break;
+            case 'k': e.dive_limit = atoi(value); break;
+            case 'd': e.depth = atoi(value); break;
+            case 'h': e.halving = atoi(value); break;
+            case 'v': e.tactic_depth = atoi(value); break;
+            default: return 0;
+        }
+        p = strchr(value, ':');
+    }
+    return 1;
+}
+
+
+static
+player_move
+engine_move(const engine_config& e, const game_state& state) {
+    DiveLimit = e.dive_limit;
+    PlayoutLimit = e.playouts;
+    NodeLimit = e.nodes;
+    RootHalving = e.halving;
+    r64 time_limit = e.time_limit;
+    player_move mv = player_pass;
+    switch (e.name[0]) {
+        case 'r': mv = random_move(state); break;
+        case 'b': mv = brute_move(state, e.depth); break;
+        case 's': mv = shallow_move(state, time_limit); break;
+        case 'm': mv = e.tactic_depth ? portfolio_move(state, time_limit, e.tactic_depth) : monte_move(state, time_limit); break;
+        case 'p': mv = puct_move(state, time_limit); break;
+    }
+    if (mv.v == player_pass.v) {
+        // lost anyway, or the engine had nothing to say
+        mv = random_move(state);
+    }
+    return mv;
+}
+
+
+// 1 when the engine playing first wins, 0 when it loses, 0.5 for a game
+// cut off after max_moves
+static
+r64
+play_game(const engine_config* engines, game_state state, u32 max_moves, engine_stats* stats) {
+    u8 first = state.current_player;
+    for (u32 moves = 0; !state.ended && moves < max_moves; ++moves) {
+        u32 side = state.current_player != first;
+        u64 playouts = Playouts;
+        auto start = chrono::steady_clock::now();
+        auto mv = engine_move(engines[side], state);
+        chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+        stats[side].playouts += Playouts - playouts;
+        stats[side].seconds += elapsed.count();
+        stats[side].moves += 1;
+        if (mv.v == player_pass.v) { break; }
+        state = next_state(state, mv);
+    }
+    if (!state.ended) { return 0.5; }
+    return state.current_player == first;
+}
+
+
+static
+r64
+elo(r64 score) {
+    score = std::clamp(score, 1e-6, 1 - 1e-6);
+    return -400 * std::log10(1 / score - 1);
+}
+
+
+static
+r64
+expected_score(r64 elo) {
+    return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+
+// log-likelihood ratio of elo1 against elo0, normal approximation of the
+// trinomial game outcomes
+static
+r64
+sprt_llr(const sprt_config& sprt, u32 wins, u32 draws, u32 losses) {
+    u32 n = wins + draws + losses;
+    if (!n || !wins || !losses) { return 0; }
+    r64 score = (wins + 0.5 * draws) / n;
+    r64 var = (wins * (1 - score) * (1 - score) + draws * (0.5 - score) * (0.5 - score) +
+        losses * score * score) / n;
+    r64 s0 = expected_score(sprt.elo0);
+    r64 s1 = expected_score(sprt.elo1);
+    return n * (s1 - s0) * (2 * score - s0 - s1) / (2 * var);
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-g games] [-t seconds] [-n playouts] [-j threads] [-p plies] [-m moves] [-e elo0,elo1] [-r seed] engine1 engine2\n", name);
+    fprintf(stderr, "  engines: random, brute, shallow, monte, puct, with settings as name:key=value...\n");
+    fprintf(stderr, "    t=seconds, n=playouts per move, x=tree nodes per move, k=dive plies, d=brute depth,\n");
+    fprintf(stderr, "    h=1 sequential halving at the root, v=tactic plies checking monte's pick\n");
+    fprintf(stderr, "  -g  most games to play, in pairs with colours swapped (default 1000)\n");
+    fprintf(stderr, "  -t  seconds per move (default 0.1)\n");
+    fprintf(stderr, "  -n  playouts per move instead of time\n");
+    fprintf(stderr, "  -j  parallel games (default: all cores)\n");
+    fprintf(stderr, "  -p  random plies after the opening (default 4)\n");
+    fprintf(stderr, "  -m  moves before a game is scored a draw (default 200)\n");
+    fprintf(stderr, "  -e  SPRT hypotheses for engine1, in Elo (default 0,10)\n");
+    fprintf(stderr, "  -r  seed for openings and searches, the same seed replays the same games\n");
+    fprintf(stderr, "  -N  network for puct\n");
+    fprintf(stderr, "  -T  tablebase for every engine\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    u32 games = 1000;
+    r64 time_limit = 0.1;
+    u32 playouts = 0;
+    u32 threads = std::thread::hardware_concurrency();
+    u32 opening_plies = 4;
+    u32 max_moves = 200;
+    sprt_config sprt = {.elo0=0, .elo1=10, .alpha=0.05, .beta=0.05};
+    for (int opt; (opt = getopt(argc, argv, "g:t:n:j:p:m:e:r:N:T:h")) != -1; ) {
+        switch (opt) {
+            case 'g': games = atoi(optarg); break;
+            case 't': time_limit = atof(optarg); break;
+            case 'n': playouts = atoi(optarg); time_limit = 0; break;
+            case 'j': threads = atoi(optarg); break;
+            case 'p': opening_plies = atoi(optarg); break;
+            case 'm': max_moves = atoi(optarg); break;
+            case 'e':
+                if (sscanf(optarg, "%lf,%lf", &sprt.elo0, &sprt.elo1) != 2) { usage(argv[0]); return 1; }
+                break;
+            case 'r': Seed = strtoull(optarg, nullptr, 0); break;
+            case 'N':
+                if (!nn_open(Network, optarg)) { return 1; }
+                break;
+            case 'T':
+                if (!tb_open(Tablebase, optarg)) { return 1; }
+                break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    engine_config engines[2];
+    if (argc - optind != 2 ||
+        !parse_engine(engines[0], argv[optind], time_limit, playouts) ||
+        !parse_engine(engines[1], argv[optind+1], time_limit, playouts)) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (auto& e : engines) {
+        if (!strcmp(e.name, "puct") && !Network.header) {
+            fprintf(stderr, "puct needs a network, -N\n");
+            return 1;
+        }
+    }
+    if (!threads) { threads = 1; }
+    Verbose = 0;
+
+    const r64 lower = std::log(sprt.beta / (1 - sprt.alpha));
+    const r64 upper = std::log((1 - sprt.beta) / sprt.alpha);
+    std::atomic<u32> next(0);
+    std::atomic<u8> done(0);
+    std::mutex lock;
+    u32 wins = 0, draws = 0, losses = 0;
+    engine_stats totals[2] = {};
+    vector<std::thread> workers;
+    for (u32 t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            std::default_random_engine rng(std::random_device{}());
+            for (u32 pair; !done && (pair = next.fetch_add(1)) < (games + 1) / 2; ) {
+                // with a seed each pair gets its own opening, whichever thread plays it
+                if (Seed) { rng.seed(Seed + pair); }
+                auto opening = random_opening(rng, opening_plies);
+                engine_stats stats[2] = {};
+                // same opening twice, each engine moving first once
+                r64 a = play_game(engines, opening, max_moves, stats);
+                const engine_config swapped[2] = {engines[1], engines[0]};
+                engine_stats swapped_stats[2] = {};
+                r64 b = 1 - play_game(swapped, opening, max_moves, swapped_stats);
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (done) { break; }
+                for (r64 score : {a, b}) {
+                    if (score == 1) { ++wins; }
+                    else if (score == 0) { ++losses; }
+                    else { ++draws; }
+                }
+                for (u32 i = 0; i < 2; ++i) {
+                    auto& s = totals[i];
+                    auto& x = stats[i];
+                    auto& y = swapped_stats[1-i];
+                    s.playouts += x.playouts + y.playouts;
+                    s.seconds += x.seconds + y.seconds;
+                    s.moves += x.moves + y.moves;
+                }
+                u32 n = wins + draws + losses;
+                r64 score = (wins + 0.5 * draws) / n;
+                r64 llr = sprt_llr(sprt, wins, draws, losses);
+                fprintf(stderr, "%u games: +%u =%u -%u, %.1f Elo, LLR %.2f [%.2f, %.2f]\n",
+                    n, wins, draws, losses, elo(score), llr, lower, upper);
+                if (llr <= lower || llr >= upper) { done = 1; }
+            }
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+
+    u32 n = wins + draws + losses;
+    if (!n) { return 1; }
+    r64 score = (wins + 0.5 * draws) / n;
+    r64 deviation = std::sqrt((wins * (1 - score) * (1 - score) + draws * (0.5 - score) * (0.5 - score) +
+        losses * score * score) / n / n);
+    r64 llr = sprt_llr(sprt, wins, draws, losses);
+    printf("%s vs %s: %u games, +%u =%u -%u\n", engines[0].spec, engines[1].spec, n, wins, draws, losses);
+    printf("elo %.1f +- %.1f\n", elo(score), (elo(score + 1.96 * deviation) - elo(score - 1.96 * deviation)) / 2);
+    printf("sprt elo0=%g elo1=%g: llr %.2f, %s\n", sprt.elo0, sprt.elo1, llr,
+        llr >= upper ? "H1 accepted" : llr <= lower ? "H0 accepted" : "inconclusive");
+    for (auto i = 0; i < 2; ++i) {
+        auto& s = totals[i];
+        printf("%s: %u moves, %.3f s/move, %.0f playouts/s\n", engines[i].spec, s.moves,
+            s.moves ? s.seconds / s.moves : 0, s.seconds > 0 ? s.playouts / s.seconds : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if __SSE2__
+#include <immintrin.h>
+#endif
+#include "game.h"
+
+
+// Value and policy network, int16 quantised, one clipped-ReLU hidden layer.
+// Everything is seen from the side to move, the board turned around for
+// player 2 so it always plays up the board.
+//
+// inputs (0 or 1):
+//   0..99      own pawns, own king, other pawns, other king, 25 squares each
+//   100..114   own hand, other hand, decked prog, 5 progs each
+// hidden:      clamp(b1 + sum of w1 rows of the set inputs, 0, 255)
+// outputs:     b2 + w2 . hidden, scaled by value_scale or policy_scale
+//   0          value logit, win probability of the side to move
+//   1..3125    move logits, by (from square * 25 + to square) * 5 + prog,
+//              moves that differ only by prog leave different hands
+//
+// File: nn_header, then i16 w1[inputs][hidden], i16 b1[hidden],
+// i16 w2[outputs][hidden], i32 b2[outputs].
+
+
+#define NN_MAGIC "MPNN"
+#define NN_VERSION 2
+#define NN_INPUTS 128
+#define NN_HIDDEN 64
+#define NN_POLICY (25 * 25 * 5)
+#define NN_OUTPUTS (1 + NN_POLICY)
+#define NN_CLIP 255
+#define NN_BATCH 8
+
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 inputs;
+    u32 hidden;
+    u32 outputs;
+    r32 value_scale;
+    r32 policy_scale;
+    u32 _reserved;
+} nn_header;
+
+
+typedef struct {
+    const nn_header* header;
+    const i16* w1;
+    const i16* b1;
+    const i16* w2;
+    const i32* b2;
+    size_t size;
+} neural_net;
+
+
+typedef struct {
+    r32 value;
+    r32 prior[5 * 2 * 4];
+} nn_output;
+
+
+static
+u8
+nn_open(neural_net& net, const char* path) {
+    net = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || size_t(st.st_size) < sizeof(nn_header)) {
+        fprintf(stderr, "%s: not a network\n", path);
+        close(fd);
+        return 0;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+    auto header = (const nn_header*) p;
+    size_t size = sizeof(nn_header) +
+        2 * (NN_INPUTS * NN_HIDDEN + NN_HIDDEN + NN_OUTPUTS * NN_HIDDEN) + 4 * NN_OUTPUTS;
+    if (memcmp(header->magic, NN_MAGIC, 4) || header->version != NN_VERSION ||
+        header->inputs != NN_INPUTS || header->hidden != NN_HIDDEN ||
+        header->outputs != NN_OUTPUTS || size > size_t(st.st_size)) {
+        fprintf(stderr, "%s: not a network\n", path);
+        munmap(p, st.st_size);
+        return 0;
+    }
+    net.header = header;
+    net.w1 = (const i16*)(header + 1);
+    net.b1 = net.w1 + NN_INPUTS * NN_HIDDEN;
+    net.w2 = net.b1 + NN_HIDDEN;
+    net.b2 = (const i32*)(net.w2 + NN_OUTPUTS * NN_HIDDEN);
+    net.size = st.st_size;
+    return 1;
+}
+
+
+static
+void
+nn_close(neural_net& net) {
+    if (net.header) {
+        munmap((void*) net.header, net.size);
+    }
+    net = {};
+}
+
+
+// square index as the side to move sees it
+static inline
+u32
+nn_square(u8 pos, u8 uid) {
+    u32 i = pos / 10 * 5 + pos % 10;
+    return uid == 1 ? i : 24 - i;
+}
+
+
+static
+u32
+nn_features(const game_state& state, u32* features) {
+    u8 uid = state.current_player;
+    u32 count = 0;
+    for (u32 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        u32 plane = (is_own(piece, uid) ? 0 : 2) + is_king(piece);
+        features[count++] = plane * 25 + nn_square(i / 5 * 10 + i % 5, uid);
+    }
+    for (u32 i = 0; i < 2; ++i) {
+        features[count++] = 100 + own_progs(state, uid).v[i];
+        features[count++] = 105 + own_progs(state, 3 - uid).v[i];
+    }
+    features[count++] = 110 + state.decked_prog;
+    return count;
+}
+
+
+static inline
+i32
+nn_dot(const i16* a, const i16* b) {
+#if __AVX2__
+    __m256i sum = _mm256_setzero_si256();
+    for (u32 i = 0; i < NN_HIDDEN; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(x, y));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+#elif __SSE2__
+    __m128i s = _mm_setzero_si128();
+    for (u32 i = 0; i < NN_HIDDEN; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        s = _mm_add_epi32(s, _mm_madd_epi16(x, y));
+    }
+#endif
+#if __SSE2__
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+#else
+    i32 sum = 0;
+    for (u32 i = 0; i < NN_HIDDEN; ++i) {
+        sum += i32(a[i]) * b[i];
+    }
+    return sum;
+#endif
+}
+
+
+// Evaluates up to NN_BATCH positions; out[i].prior follows valid[i].
+static
+void
+nn_evaluate(const neural_net& net, const game_state* states, const vector<player_move>* valid, u32 count, nn_output* out) {
+    // the network stands in for the rollout
+    PROFILE_SCOPE(PROFILE_ROLLOUT);
+    alignas(32) i16 hidden[NN_BATCH][NN_HIDDEN];
+    for (u32 b = 0; b < count; ++b) {
+        i32 acc[NN_HIDDEN];
+        for (u32 j = 0; j < NN_HIDDEN; ++j) { acc[j] = net.b1[j]; }
+        u32 features[32];
+        u32 n = nn_features(states[b], features);
+        for (u32 f = 0; f < n; ++f) {
+            const i16* row = net.w1 + features[f] * NN_HIDDEN;
+            for (u32 j = 0; j < NN_HIDDEN; ++j) { acc[j] += row[j]; }
+        }
+        for (u32 j = 0; j < NN_HIDDEN; ++j) {
+            hidden[b][j] = acc[j] < 0 ? 0 : acc[j] > NN_CLIP ? NN_CLIP : acc[j];
+        }
+    }
+    const r32 value_scale = net.header->value_scale;
+    const r32 policy_scale = net.header->policy_scale;
+    for (u32 b = 0; b < count; ++b) {
+        r32 x = value_scale * (net.b2[0] + nn_dot(net.w2, hidden[b]));
+        out[b].value = 1 / (1 + std::exp(-x));
+    }
+    for (u32 b = 0; b < count; ++b) {
+        u8 uid = states[b].current_player;
+        auto& moves = valid[b];
+        r32 top = -1e30, total = 0;
+        for (u32 i = 0; i < moves.size(); ++i) {
+            u32 k = 1 + (nn_square(moves[i].from, uid) * 25 + nn_square(moves[i].to, uid)) * 5 + moves[i].pid;
+            r32 logit = policy_scale * (net.b2[k] + nn_dot(net.w2 + k * NN_HIDDEN, hidden[b]));
+            out[b].prior[i] = logit;
+            if (logit > top) { top = logit; }
+        }
+        for (u32 i = 0; i < moves.size(); ++i) {
+            out[b].prior[i] = std::exp(out[b].prior[i] - top);
+            total += out[b].prior[i];
+        }
+        for (u32 i = 0; i < moves.size(); ++i) {
+            out[b].prior[i] /= total;
+        }
+    }
+}
@@ -0,0 +1,493 @@
+// cc -std=c++20 -lc++ -O3 -o perft perft.cpp
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "game.h"
+
+
+// arac's rules, compiled natively next to brute's
+namespace arac {
+#include "../arac/arac.cpp"
+void* __heap_base = nullptr;
+r64 host_time_now(void) { return 0; }
+r64 host_random(void) { return 0; }
+}
+
+
+namespace chrono = std::chrono;
+using std::unordered_set;
+using std::vector;
+
+
+#define MAX_DEPTH 12
+
+
+static_assert(sizeof(game_state) == sizeof(arac::game_state), "brute and arac states differ");
+
+
+// The rules as first written, the yardstick for faster generators.
+
+static
+u32
+reference_terminal(const game_state& state) {
+    u8 p1 = 0, p2 = 0;
+    for (u32 y = 0; y < 5; ++y) {
+        for (u32 x = 0; x < 5; ++x) {
+            u8 piece = state.board[y][x];
+            if (piece == 13) {
+                if (y == 0 && x == 2) { return 1; }
+                p1 = 1;
+            }
+            else if (piece == 23) {
+                if (y == 4 && x == 2) { return 1; }
+                p2 = 1;
+            }
+        }
+    }
+    return !(p1 && p2);
+}
+
+
+static
+void
+reference_moves(const game_state& state, vector<player_move>& valid) {
+    valid.clear();
+    u8 uid = state.current_player;
+    i8 rotate = 3 - 2 * uid;
+    for (u32 y = 0; y < 5; ++y) {
+        for (u32 x = 0; x < 5; ++x) {
+            u8 piece = state.board[y][x];
+            if (piece / 10 != uid) { continue; }
+            for (u8 pid : state.player_progs[uid-1]) {
+                for (i8 d : Progs[pid]) {
+                    if (!d) { continue; }
+                    i8 from = y * 10 + x;
+                    i8 to = from + d * rotate;
+                    if (to % 10 < 0 || to % 10 > 4 || to / 10 < 0 || to / 10 > 4) { continue; }
+                    if (state.board[to / 10][to % 10] / 10 == uid) { continue; }
+                    valid.push_back({.from=u8(from), .to=u8(to), .pid=pid});
+                }
+            }
+        }
+    }
+}
+
+
+static
+game_state
+reference_next(const game_state& state, const player_move& mv) {
+    auto next = state;
+    u8 uid = state.current_player;
+    next.current_player = 3 - uid;
+    next.board[mv.to / 10][mv.to % 10] = state.board[mv.from / 10][mv.from % 10];
+    next.board[mv.from / 10][mv.from % 10] = 0;
+    next.ended = reference_terminal(next);
+    if (next.ended) {
+        next.current_player = uid;
+        next.win = 1;
+        return next;
+    }
+    for (u32 i = 0; i < 2; ++i) {
+        if (state.player_progs[uid-1][i] == mv.pid) {
+            next.player_progs[uid-1][i] = state.decked_prog;
+            next.decked_prog = mv.pid;
+            break;
+        }
+    }
+    return next;
+}
+
+
+static inline
+arac::game_state
+to_arac(const game_state& state) {
+    arac::game_state s;
+    memcpy(&s, &state, sizeof(s));
+    return s;
+}
+
+
+static inline
+u32
+move_key(u8 from, u8 to, u8 pid) {
+    return from << 16 | to << 8 | pid;
+}
+
+
+static
+u8
+same_state(const game_state& a, const game_state& b) {
+    return a.current_player == b.current_player && !memcmp(a.pieces, b.pieces, 25) &&
+        !memcmp(a.progs, b.progs, 5) && a.ended == b.ended && a.win == b.win;
+}
+
+
+static
+void
+print_state(const game_state& state) {
+    fprintf(stderr, "  player %u, progs %u %u%u %u%u%s\n", state.current_player, state.decked_prog,
+        state.p1_progs[0], state.p1_progs[1], state.p2_progs[0], state.p2_progs[1], state.ended ? ", ended" : "");
+    for (u32 y = 0; y < 5; ++y) {
+        fprintf(stderr, "  ");
+        for (u32 x = 0; x < 5; ++x) {
+            fprintf(stderr, " %02u", state.board[y][x]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+
+typedef struct {
+    u64 nodes[MAX_DEPTH + 1];
+    u64 mismatches;
+    vector<game_state>* sample;
+    size_t sample_limit;
+} perft_check;
+
+
+static
+void
+mismatch(perft_check& check, const game_state& state, const char* what) {
+    if (check.mismatches++ < 10) {
+        fprintf(stderr, "mismatch: %s\n", what);
+        print_state(state);
+    }
+}
+
+
+// walks the tree with brute's rules and checks every node against the
+// reference rules and arac's
+static
+void
+perft_walk(perft_check& check, const game_state& state, u32 depth, u32 ply) {
+    check.nodes[ply] += 1;
+    if (ply == depth || state.ended) { return; }
+    if (check.sample && check.sample->size() < check.sample_limit) {
+        check.sample->push_back(state);
+    }
+
+    auto packed = pack_state(state);
+    auto as = to_arac(state);
+    if (packed.v != arac::pack_state(as).v) {
+        mismatch(check, state, "pack_state, brute and arac");
+    }
+    if (pack_state(unpack_state(packed)).v != packed.v) {
+        mismatch(check, state, "unpack_state does not repack");
+    }
+    if (is_terminal(state) != reference_terminal(state) || is_terminal(state) != arac::is_terminal(as)) {
+        mismatch(check, state, "is_terminal");
+    }
+
+    auto valid = valid_moves(state, state.current_player);
+    vector<player_move> reference;
+    reference_moves(state, reference);
+    arac::mc_valid avalid;
+    arac::valid_moves(avalid, as, as.current_player);
+
+    vector<u32> a, b, c;
+    for (auto& mv : valid) { a.push_back(move_key(mv.from, mv.to, mv.pid)); }
+    for (auto& mv : reference) { b.push_back(move_key(mv.from, mv.to, mv.pid)); }
+    for (u32 i = 0; i < avalid.size(); ++i) {
+        auto& mv = avalid.values[i];
+        c.push_back(move_key(mv.from, mv.to, mv.pid));
+    }
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    std::sort(c.begin(), c.end());
+    if (a != b) { mismatch(check, state, "valid_moves, brute and reference"); }
+    if (a != c) { mismatch(check, state, "valid_moves, brute and arac"); }
+
+    for (auto& mv : valid) {
+        auto next = next_state(state, mv);
+        if (!same_state(next, reference_next(state, mv))) {
+            mismatch(check, state, "next_state, brute and reference");
+        }
+        arac::player_move amv = {};
+        amv.from = mv.from;
+        amv.to = mv.to;
+        amv.pid = mv.pid;
+        auto an = arac::next_state(as, amv);
+        game_state converted;
+        memcpy(&converted, &an, sizeof(converted));
+        if (!same_state(next, converted)) {
+            mismatch(check, state, "next_state, brute and arac");
+        }
+        auto made = state;
+        move_undo undo;
+        make_move(made, mv, undo);
+        if (!same_state(next, made)) { mismatch(check, state, "make_move, brute and next_state"); }
+        unmake_move(made, undo);
+        if (!same_state(state, made)) { mismatch(check, state, "unmake_move, brute"); }
+        auto amade = as;
+        arac::move_undo aundo;
+        arac::make_move(amade, amv, aundo);
+        if (memcmp(&amade, &an, sizeof(an))) { mismatch(check, state, "make_move, arac and next_state"); }
+        arac::unmake_move(amade, aundo);
+        if (memcmp(&amade, &as, sizeof(as))) { mismatch(check, state, "unmake_move, arac"); }
+        perft_walk(check, next, depth, ply + 1);
+    }
+}
+
+
+static
+u64
+perft_brute(const game_state& state, u32 depth) {
+    if (!depth) { return 1; }
+    if (state.ended) { return 0; }
+    u64 n = 0;
+    for (auto& mv : valid_moves(state, state.current_player)) {
+        n += perft_brute(next_state(state, mv), depth - 1);
+    }
+    return n;
+}
+
+
+static
+u64
+perft_reference(const game_state& state, u32 depth) {
+    if (!depth) { return 1; }
+    if (state.ended) { return 0; }
+    vector<player_move> valid;
+    reference_moves(state, valid);
+    u64 n = 0;
+    for (auto& mv : valid) {
+        n += perft_reference(reference_next(state, mv), depth - 1);
+    }
+    return n;
+}
+
+
+static
+u64
+perft_arac(const arac::game_state& state, u32 depth) {
+    if (!depth) { return 1; }
+    if (state.ended) { return 0; }
+    arac::mc_valid valid;
+    arac::valid_moves(valid, state, state.current_player);
+    u64 n = 0;
+    for (u32 i = 0; i < valid.size(); ++i) {
+        n += perft_arac(arac::next_state(state, valid.values[i]), depth - 1);
+    }
+    return n;
+}
+
+
+template<typename F>
+static
+r64
+timed(F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+
+static
+void
+report(const char* name, u64 calls, r64 seconds) {
+    printf("  %-24s %12" PRIu64 " calls %10.0f k/s\n", name, calls, seconds > 0 ? calls / seconds / 1000 : 0);
+}
+
+
+// every function timed on its own over the sampled positions
+static
+void
+bench_functions(const vector<game_state>& sample) {
+    static volatile u64 sink;
+    u64 moves = 0;
+    vector<arac::game_state> asample;
+    for (auto& s : sample) { asample.push_back(to_arac(s)); }
+
+    printf("brute:\n");
+    r64 t = timed([&]() {
+        for (auto& s : sample) { moves += valid_moves(s, s.current_player).size(); }
+    });
+    report("valid_moves", sample.size(), t);
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : sample) {
+            for (auto& mv : valid_moves(s, s.current_player)) { x += next_state(s, mv).ended; }
+        }
+        sink = x;
+    });
+    report("valid_moves + next_state", moves, t);
+    t = timed([&]() {
+        u64 x = 0;
+        move_undo undo;
+        for (auto s : sample) {
+            for (auto& mv : valid_moves(s, s.current_player)) {
+                make_move(s, mv, undo);
+                x += s.ended;
+                unmake_move(s, undo);
+            }
+        }
+        sink = x;
+    });
+    report("valid_moves + make/unmake", moves, t);
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : sample) { x += is_terminal(s); }
+        sink = x;
+    });
+    report("is_terminal", sample.size(), t);
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : sample) { x ^= pack_state(s).v; }
+        sink = x;
+    });
+    report("pack_state", sample.size(), t);
+
+    printf("arac:\n");
+    arac::mc_valid valid;
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : asample) {
+            arac::valid_moves(valid, s, s.current_player);
+            x += valid.size();
+        }
+        sink = x;
+    });
+    report("valid_moves", asample.size(), t);
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : asample) {
+            arac::valid_moves(valid, s, s.current_player);
+            for (u32 i = 0; i < valid.size(); ++i) { x += arac::next_state(s, valid.values[i]).ended; }
+        }
+        sink = x;
+    });
+    report("valid_moves + next_state", moves, t);
+    t = timed([&]() {
+        u64 x = 0;
+        arac::move_undo undo;
+        for (auto s : asample) {
+            arac::valid_moves(valid, s, s.current_player);
+            for (u32 i = 0; i < valid.size(); ++i) {
+                arac::make_move(s, valid.values[i], undo);
+                x += s.ended;
+                arac::unmake_move(s, undo);
+            }
+        }
+        sink = x;
+    });
+    report("valid_moves + make/unmake", moves, t);
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : asample) { x += arac::is_terminal(s); }
+        sink = x;
+    });
+    report("is_terminal", asample.size(), t);
+    t = timed([&]() {
+        u64 x = 0;
+        for (auto& s : asample) { x ^= arac::pack_state(s).v; }
+        sink = x;
+    });
+    report("pack_state", asample.size(), t);
+}
+
+
+static
+vector<game_state>
+opening_corpus() {
+    vector<game_state> corpus;
+    unordered_set<u64> seen;
+    game_state state = {};
+    state.current_player = 1;
+    for (u32 x = 0; x < 5; ++x) {
+        state.board[0][x] = 21 + x;
+        state.board[4][x] = 11 + x;
+    }
+    u8 progs[5] = {0, 1, 2, 3, 4};
+    do {
+        for (u32 i = 0; i < 5; ++i) { state.progs[i] = progs[i]; }
+        if (seen.insert(pack_state(state).v).second) {
+            corpus.push_back(state);
+        }
+    } while (std::next_permutation(progs, progs + 5));
+    return corpus;
+}
+
+
+static
+u8
+read_corpus(const char* path, vector<game_state>& corpus) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return 0;
+    }
+    game_state_data data;
+    while (fread(&data, sizeof(data), 1, fp) == 1) {
+        game_state state = {};
+        memcpy(&state, &data, sizeof(data));
+        state.ended = is_terminal(state);
+        state.win = state.ended;
+        corpus.push_back(state);
+    }
+    fclose(fp);
+    return 1;
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-d depth] [-i corpus] [-s sample]\n", name);
+    fprintf(stderr, "  -d  plies to count (default 4)\n");
+    fprintf(stderr, "  -i  positions as 31-byte states, as brute reads them (default: the openings)\n");
+    fprintf(stderr, "  -s  positions sampled for the per-function timings (default 1000000)\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    u32 depth = 4;
+    size_t sample_limit = 1000000;
+    vector<game_state> corpus;
+    for (int opt; (opt = getopt(argc, argv, "d:i:s:h")) != -1; ) {
+        switch (opt) {
+            case 'd': depth = atoi(optarg); break;
+            case 'i':
+                if (!read_corpus(optarg, corpus)) { return 1; }
+                break;
+            case 's': sample_limit = atoll(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (depth > MAX_DEPTH) {
+        fprintf(stderr, "depth is at most %u\n", MAX_DEPTH);
+        return 1;
+    }
+    if (corpus.empty()) { corpus = opening_corpus(); }
+
+    vector<game_state> sample;
+    perft_check check = {.sample=&sample, .sample_limit=sample_limit};
+    for (auto& s : corpus) { perft_walk(check, s, depth, 0); }
+    printf("%zu positions\n", corpus.size());
+    for (u32 d = 1; d <= depth; ++d) {
+        printf("  depth %2u: %14" PRIu64 "\n", d, check.nodes[d]);
+    }
+    printf("%" PRIu64 " mismatches\n", check.mismatches);
+
+    u64 counts[3] = {};
+    r64 seconds[3] = {};
+    seconds[0] = timed([&]() { for (auto& s : corpus) { counts[0] += perft_brute(s, depth); } });
+    seconds[1] = timed([&]() { for (auto& s : corpus) { counts[1] += perft_reference(s, depth); } });
+    seconds[2] = timed([&]() { for (auto& s : corpus) { counts[2] += perft_arac(to_arac(s), depth); } });
+    const char* names[3] = {"brute", "reference", "arac"};
+    printf("perft %u:\n", depth);
+    for (u32 i = 0; i < 3; ++i) {
+        printf("  %-10s %14" PRIu64 " leaves %8.3f s %10.0f k/s%s\n", names[i], counts[i], seconds[i],
+            seconds[i] > 0 ? counts[i] / seconds[i] / 1000 : 0, counts[i] != check.nodes[depth] ? "  MISMATCH" : "");
+        if (counts[i] != check.nodes[depth]) { check.mismatches += 1; }
+    }
+
+    bench_functions(sample);
+    return check.mismatches ? 1 : 0;
+}
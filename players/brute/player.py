@@ -1,16 +1,65 @@
 #!/usr/bin/env python
+import getopt
 import json
+import os
 import struct
 import subprocess
 import sys
+import threading
 from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
 
 
+# extra brute flags, e.g. `player.py -s brute.tt` to share a node table
+BruteArgs = sys.argv[1:]
+
+# brute in process through libbrute.so when it is built and knows the
+# flags. ThreadingHTTPServer runs every request on a new thread, so engines
+# are pooled: a request takes one, or makes one when all are busy, and
+# puts it back, trees and all, for the next move to search on
+LibraryFlags = {'-t':'tablebase', '-b':'book', '-s':'shared_table', '-n':'network', '-k':'dive_limit', '-c':'seconds'}
+Engines = []
+EnginesLock = threading.Lock()
+
+def library_options():
+    if not os.path.exists(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libbrute.so')):
+        return
+    try:
+        opts, rest = getopt.getopt(BruteArgs, 't:b:s:n:k:c:')
+    except getopt.GetoptError:
+        return
+    if rest:
+        return
+    options = {LibraryFlags[k]:v for k,v in opts}
+    for k in ('dive_limit', 'seconds'):
+        if k in options:
+            options[k] = float(options[k]) if k == 'seconds' else int(options[k])
+    return options
+
+LibraryOptions = library_options()
+
+def library_move(state):
+    import pybrute
+    options = dict(LibraryOptions)
+    seconds = options.pop('seconds', 3)
+    with EnginesLock:
+        engine = Engines.pop() if Engines else None
+    if engine is None:
+        engine = pybrute.Engine(**options)
+    try:
+        engine.set_position(state)
+        engine.search(seconds=seconds)
+        return engine.best_move()
+    finally:
+        with EnginesLock:
+            Engines.append(engine)
+
 def player_move(state):
+    if LibraryOptions is not None:
+        return library_move(state)
     data = struct.pack('<B', state['currentPlayer'])
     data += struct.pack('<25B', *state['board'])
     data += struct.pack('<5B', *state['progs'])
-    p = subprocess.run('./brute', stdout=subprocess.PIPE, input=data, stderr=sys.stderr.buffer)
+    p = subprocess.run(['./brute', *BruteArgs], stdout=subprocess.PIPE, input=data, stderr=sys.stderr.buffer)
     if p.returncode:
         print(p.stderr.decode(), file=sys.stderr)
         return
@@ -34,8 +83,12 @@ class GameHttpHandler (BaseHTTPRequestHandler):
         n = int(n)
         data = self.rfile.read(n)
 
-        game_state = json.loads(data)
-        move = player_move(game_state)
+        try:
+            game_state = json.loads(data)
+            move = player_move(game_state)
+        except (ValueError, KeyError, TypeError, struct.error) as e:
+            self.send_error(400, f'malformed state: {e}')
+            return
         self.log_message(f'player move {move}')
         data = json.dumps(move, separators=',:')
         data = data.encode()
@@ -0,0 +1,113 @@
+#pragma once
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+
+// Scoped timers around the search hot path, built with -DPROFILE=1 (make
+// PROFILE=1). Ticks are rdtsc where there is one, ns otherwise; counts
+// are per thread and inclusive, so rollout contains the move generation
+// it does. Without PROFILE the scopes are empty and cost nothing.
+
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+
+enum {
+    PROFILE_MOVEGEN,
+    PROFILE_NEXT_STATE,
+    PROFILE_PACK,
+    PROFILE_LOOKUP,
+    PROFILE_SELECT,
+    PROFILE_ROLLOUT,
+    PROFILE_BACKUP,
+    PROFILE_PHASES,
+};
+
+
+#if PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+typedef struct {
+    uint64_t ticks[PROFILE_PHASES];
+    uint64_t calls[PROFILE_PHASES];
+    uint64_t start;
+} profile_counters;
+
+
+static thread_local profile_counters Profile;
+
+
+static inline
+uint64_t
+profile_ticks(void) {
+    #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+    #else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    #endif
+}
+
+
+struct profile_scope {
+    uint32_t phase;
+    uint64_t start;
+
+    profile_scope(uint32_t phase) : phase(phase), start(profile_ticks()) {}
+    ~profile_scope() {
+        Profile.ticks[phase] += profile_ticks() - start;
+        Profile.calls[phase] += 1;
+    }
+};
+
+
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_NAME(line) PROFILE_JOIN(profile_scope_, line)
+#define PROFILE_SCOPE(phase) profile_scope PROFILE_NAME(__LINE__)(phase)
+
+
+// a search starts counting from zero
+static inline
+void
+profile_reset(void) {
+    Profile = {};
+    Profile.start = profile_ticks();
+}
+
+
+// counters of this thread as a share of the search so far
+static
+void
+profile_dump(FILE* out) {
+    static const char* names[PROFILE_PHASES] = {
+        "movegen", "next_state", "pack", "lookup", "select", "rollout", "backup",
+    };
+    uint64_t total = profile_ticks() - Profile.start;
+    flockfile(out);
+    fprintf(out, "%-10s %12s       %10" PRIu64 " ticks\n", "search", "", total);
+    for (uint32_t i = 0; i < PROFILE_PHASES; ++i) {
+        uint64_t calls = Profile.calls[i];
+        if (!calls) { continue; }
+        fprintf(out, "%-10s %12" PRIu64 " calls %10.1f ticks/call %6.1f%%\n", names[i], calls,
+            double(Profile.ticks[i]) / calls, total ? 100.0 * Profile.ticks[i] / total : 0);
+    }
+    funlockfile(out);
+}
+
+#else
+
+#define PROFILE_SCOPE(phase)
+
+static inline void profile_reset(void) {}
+static inline void profile_dump(FILE*) {}
+
+#endif
@@ -0,0 +1,107 @@
+import ctypes
+import os
+import struct
+
+
+# Binding to libbrute.so (make libbrute.so), see libbrute.h for the calls.
+#
+#   engine = Engine(book='brute.book')
+#   engine.set_position(state)    # {currentPlayer, board, progs} as player.py gets it
+#   engine.search(seconds=1, threads=4)
+#   engine.best_move(), engine.root_stats()
+
+
+class Options (ctypes.Structure):
+    _fields_ = [
+        ('tablebase', ctypes.c_char_p),
+        ('book', ctypes.c_char_p),
+        ('shared_table', ctypes.c_char_p),
+        ('network', ctypes.c_char_p),
+        ('dive_limit', ctypes.c_uint32),
+    ]
+
+
+class MoveStats (ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [
+        ('ver', ctypes.c_uint8),
+        ('from_', ctypes.c_uint8),
+        ('to', ctypes.c_uint8),
+        ('pid', ctypes.c_uint8),
+        ('visits', ctypes.c_uint32),
+        ('score', ctypes.c_float),
+    ]
+
+
+def load(path=None):
+    path = path or os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libbrute.so')
+    lib = ctypes.CDLL(path)
+    lib.brute_create.argtypes = [ctypes.POINTER(Options)]
+    lib.brute_create.restype = ctypes.c_void_p
+    lib.brute_destroy.argtypes = [ctypes.c_void_p]
+    lib.brute_destroy.restype = None
+    lib.brute_set_position.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.brute_set_position.restype = ctypes.c_int
+    lib.brute_search.argtypes = [ctypes.c_void_p, ctypes.c_double, ctypes.c_uint32, ctypes.c_uint32, ctypes.c_uint32]
+    lib.brute_search.restype = ctypes.c_uint32
+    lib.brute_best_move.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.brute_best_move.restype = ctypes.c_int
+    lib.brute_root_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(MoveStats), ctypes.c_uint32]
+    lib.brute_root_stats.restype = ctypes.c_uint32
+    lib.brute_release.argtypes = [ctypes.c_void_p]
+    lib.brute_release.restype = None
+    return lib
+
+
+def state_data(state):
+    data = struct.pack('<B', state['currentPlayer'])
+    data += struct.pack('<25B', *state['board'])
+    data += struct.pack('<5B', *state['progs'])
+    return data
+
+
+class Engine:
+    _lib = None
+
+    def __init__(self, tablebase=None, book=None, shared_table=None, network=None, dive_limit=0, path=None):
+        if Engine._lib is None:
+            Engine._lib = load(path)
+        enc = lambda s: s.encode() if s else None
+        options = Options(enc(tablebase), enc(book), enc(shared_table), enc(network), dive_limit)
+        self._engine = self._lib.brute_create(ctypes.byref(options))
+        if not self._engine:
+            raise OSError('brute_create failed')
+
+    def close(self):
+        if self._engine:
+            self._lib.brute_destroy(self._engine)
+            self._engine = None
+
+    def __del__(self):
+        self.close()
+
+    def set_position(self, state):
+        data = state if isinstance(state, bytes) else state_data(state)
+        if len(data) != 31 or not self._lib.brute_set_position(self._engine, data):
+            raise ValueError('malformed state')
+
+    # playouts or nodes, when given, stand in for seconds
+    def search(self, seconds=3, playouts=0, nodes=0, threads=1):
+        return self._lib.brute_search(self._engine, seconds, playouts, nodes, threads)
+
+    # [from, to, pid] or None
+    def best_move(self):
+        move = ctypes.create_string_buffer(4)
+        if not self._lib.brute_best_move(self._engine, move):
+            return None
+        return list(move.raw[1:4])
+
+    # [([from, to, pid], visits, score)], most visited first
+    def root_stats(self):
+        n = self._lib.brute_root_stats(self._engine, None, 0)
+        stats = (MoveStats * n)()
+        self._lib.brute_root_stats(self._engine, stats, n)
+        return [([s.from_, s.to, s.pid], s.visits, s.score) for s in stats]
+
+    def release(self):
+        self._lib.brute_release(self._engine)
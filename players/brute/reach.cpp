@@ -0,0 +1,456 @@
+// cc -std=c++20 -lc++ -O3 -pthread -o reach reach.cpp
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game.h"
+
+
+namespace chrono = std::chrono;
+using std::string;
+using std::vector;
+
+
+// Breadth-first enumeration of every position reachable from the opening.
+// Each ply's frontier lives on disk as a sorted file of packed_state keys.
+// Expansion spills sorted runs, which are merged, deduplicated and
+// subtracted from the visited set to produce the next frontier.
+
+
+#define RS_MAGIC "MPRS"
+#define RS_VERSION 1
+
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u64 count;
+} rs_header;
+
+
+typedef struct {
+    FILE* fp;
+    vector<u64> buf;
+    size_t pos;
+    size_t size;
+    u64 value;
+    u8 done;
+} key_reader;
+
+
+typedef struct {
+    FILE* fp;
+    vector<u64> buf;
+    u64 count;
+} key_writer;
+
+
+typedef struct {
+    u64 states;
+    u64 terminal;
+    u64 classes[5][5];
+} ply_stats;
+
+
+typedef struct {
+    string workdir;
+    u32 threads;
+    size_t run_keys;
+    u32 runs;
+    std::mutex lock;
+} reach_context;
+
+
+static
+void
+die(const char* what) {
+    perror(what);
+    exit(1);
+}
+
+
+static
+void
+reader_next(key_reader& r) {
+    if (r.pos == r.size) {
+        r.size = r.fp ? fread(r.buf.data(), sizeof(u64), r.buf.size(), r.fp) : 0;
+        r.pos = 0;
+        if (!r.size) {
+            r.done = 1;
+            return;
+        }
+    }
+    r.value = r.buf[r.pos++];
+}
+
+
+static
+void
+reader_open(key_reader& r, const string& path) {
+    r.fp = fopen(path.c_str(), "rb");
+    if (!r.fp) { die(path.c_str()); }
+    r.buf.resize(0x10000);
+    r.pos = r.size = 0;
+    r.done = 0;
+    reader_next(r);
+}
+
+
+static
+void
+reader_close(key_reader& r) {
+    if (r.fp) { fclose(r.fp); }
+    r.fp = nullptr;
+}
+
+
+static
+void
+writer_open(key_writer& w, const string& path) {
+    w.fp = fopen(path.c_str(), "wb");
+    if (!w.fp) { die(path.c_str()); }
+    w.buf.clear();
+    w.buf.reserve(0x10000);
+    w.count = 0;
+}
+
+
+static
+void
+writer_flush(key_writer& w) {
+    if (fwrite(w.buf.data(), sizeof(u64), w.buf.size(), w.fp) != w.buf.size()) {
+        die("write");
+    }
+    w.buf.clear();
+}
+
+
+static inline
+void
+writer_put(key_writer& w, u64 key) {
+    w.buf.push_back(key);
+    ++w.count;
+    if (w.buf.size() == w.buf.capacity()) { writer_flush(w); }
+}
+
+
+static
+void
+writer_close(key_writer& w) {
+    writer_flush(w);
+    if (fclose(w.fp)) { die("close"); }
+    w.fp = nullptr;
+}
+
+
+static
+string
+run_path(const reach_context& ctx, u32 run) {
+    return ctx.workdir + "/run." + std::to_string(run);
+}
+
+
+static
+void
+spill_run(reach_context& ctx, vector<u64>& keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    u32 run;
+    {
+        std::lock_guard<std::mutex> guard(ctx.lock);
+        run = ctx.runs++;
+    }
+    key_writer w;
+    writer_open(w, run_path(ctx, run));
+    for (u64 k : keys) { writer_put(w, k); }
+    writer_close(w);
+    keys.clear();
+}
+
+
+static
+void
+expand(reach_context& ctx, const string& frontier, u64 count) {
+    if (!count) { return; }
+    int fd = open(frontier.c_str(), O_RDONLY);
+    if (fd < 0) { die(frontier.c_str()); }
+    auto keys = (const u64*) mmap(nullptr, count * sizeof(u64), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (keys == MAP_FAILED) { die(frontier.c_str()); }
+
+    std::atomic<u64> next(0);
+    const u64 chunk = 0x1000;
+    vector<std::thread> workers;
+    for (u32 t = 0; t < ctx.threads; ++t) {
+        workers.emplace_back([&]() {
+            vector<u64> children;
+            children.reserve(ctx.run_keys);
+            for (;;) {
+                u64 start = next.fetch_add(chunk);
+                if (start >= count) { break; }
+                u64 end = std::min(count, start + chunk);
+                for (u64 i = start; i < end; ++i) {
+                    auto state = unpack_state({.v=keys[i]});
+                    if (state.ended) { continue; }
+                    for (auto& mv : valid_moves(state, state.current_player)) {
+                        children.push_back(pack_state(next_state(state, mv)).v);
+                    }
+                    if (children.size() + 100 >= ctx.run_keys) {
+                        spill_run(ctx, children);
+                    }
+                }
+            }
+            if (!children.empty()) {
+                spill_run(ctx, children);
+            }
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+    munmap((void*) keys, count * sizeof(u64));
+}
+
+
+static
+void
+count_key(ply_stats& stats, u64 key) {
+    packed_state packed = {.v=key};
+    const u64 pawns1[4] = {packed.player1_p1, packed.player1_p2, packed.player1_p4, packed.player1_p5};
+    const u64 pawns2[4] = {packed.player2_p1, packed.player2_p2, packed.player2_p4, packed.player2_p5};
+    u32 a = 0, b = 0;
+    for (u32 i = 0; i < 4; ++i) {
+        a += pawns1[i] < 25;
+        b += pawns2[i] < 25;
+    }
+    ++stats.states;
+    ++stats.classes[a][b];
+    if (packed.player1_king >= 25 || packed.player2_king >= 25 ||
+        packed.player1_king == 2 || packed.player2_king == 22) {
+        ++stats.terminal;
+    }
+}
+
+
+// merges all runs, drops keys already visited, writes the new frontier
+// and the updated visited set
+static
+void
+merge_runs(reach_context& ctx, const string& visited, const string& next_visited,
+        const string& frontier, ply_stats& stats) {
+    vector<key_reader> runs(ctx.runs);
+    for (u32 i = 0; i < ctx.runs; ++i) {
+        reader_open(runs[i], run_path(ctx, i));
+    }
+    key_reader seen;
+    reader_open(seen, visited);
+    key_writer out, all;
+    writer_open(out, frontier);
+    writer_open(all, next_visited);
+
+    auto cmp = [&](u32 a, u32 b) { return runs[a].value > runs[b].value; };
+    vector<u32> heap;
+    for (u32 i = 0; i < ctx.runs; ++i) {
+        if (!runs[i].done) { heap.push_back(i); }
+    }
+    std::make_heap(heap.begin(), heap.end(), cmp);
+
+    u8 have_last = 0;
+    u64 last = 0;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        u32 i = heap.back();
+        u64 key = runs[i].value;
+        reader_next(runs[i]);
+        if (runs[i].done) { heap.pop_back(); }
+        else { std::push_heap(heap.begin(), heap.end(), cmp); }
+
+        if (have_last && key == last) { continue; }
+        have_last = 1;
+        last = key;
+        while (!seen.done && seen.value < key) {
+            writer_put(all, seen.value);
+            reader_next(seen);
+        }
+        if (!seen.done && seen.value == key) { continue; }
+        writer_put(out, key);
+        writer_put(all, key);
+        count_key(stats, key);
+    }
+    while (!seen.done) {
+        writer_put(all, seen.value);
+        reader_next(seen);
+    }
+
+    for (u32 i = 0; i < ctx.runs; ++i) {
+        reader_close(runs[i]);
+        unlink(run_path(ctx, i).c_str());
+    }
+    reader_close(seen);
+    writer_close(out);
+    writer_close(all);
+    ctx.runs = 0;
+}
+
+
+static
+void
+print_stats(const char* label, const ply_stats& stats) {
+    fprintf(stderr, "%s: %" PRIu64 " states, %" PRIu64 " terminal\n", label, stats.states, stats.terminal);
+    for (u32 a = 0; a < 5; ++a) {
+        for (u32 b = 0; b < 5; ++b) {
+            if (stats.classes[a][b]) {
+                fprintf(stderr, "  %u-%u: %" PRIu64 "\n", a, b, stats.classes[a][b]);
+            }
+        }
+    }
+}
+
+
+static inline
+void
+put_varint(FILE* fp, u64 x) {
+    while (x >= 0x80) {
+        fputc(int(x & 0x7f) | 0x80, fp);
+        x >>= 7;
+    }
+    fputc(int(x), fp);
+}
+
+
+// sorted keys as LEB128 deltas behind a small header
+static
+void
+write_compact(const string& visited, const char* path, u64 count) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) { die(path); }
+    rs_header header = {};
+    memcpy(header.magic, RS_MAGIC, 4);
+    header.version = RS_VERSION;
+    header.count = count;
+    fwrite(&header, sizeof(header), 1, fp);
+    key_reader r;
+    reader_open(r, visited);
+    u64 prev = 0;
+    for (; !r.done; reader_next(r)) {
+        put_varint(fp, r.value - prev);
+        prev = r.value;
+    }
+    reader_close(r);
+    if (ferror(fp) | fclose(fp)) { die(path); }
+}
+
+
+static
+vector<u64>
+opening_keys(void) {
+    game_state state = {};
+    state.current_player = 1;
+    for (u32 x = 0; x < 5; ++x) {
+        state.board[0][x] = 21 + x;
+        state.board[4][x] = 11 + x;
+    }
+    vector<u64> keys;
+    u8 progs[5] = {0, 1, 2, 3, 4};
+    do {
+        for (u32 i = 0; i < 5; ++i) { state.progs[i] = progs[i]; }
+        keys.push_back(pack_state(state).v);
+    } while (std::next_permutation(progs, progs + 5));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-d plies] [-j threads] [-m megabytes] [-w workdir] [-o path]\n", name);
+    fprintf(stderr, "  -d  stop after this many plies (default: until exhausted)\n");
+    fprintf(stderr, "  -j  worker threads (default: all cores)\n");
+    fprintf(stderr, "  -m  memory for sorted runs (default 1024)\n");
+    fprintf(stderr, "  -w  directory for frontier and run files (default .)\n");
+    fprintf(stderr, "  -o  sorted state set (default reach.rs)\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    reach_context ctx;
+    ctx.workdir = ".";
+    ctx.threads = std::thread::hardware_concurrency();
+    ctx.runs = 0;
+    u32 max_plies = -1;
+    size_t megabytes = 1024;
+    const char* path = "reach.rs";
+    for (int opt; (opt = getopt(argc, argv, "d:j:m:w:o:h")) != -1; ) {
+        switch (opt) {
+            case 'd': max_plies = atoi(optarg); break;
+            case 'j': ctx.threads = atoi(optarg); break;
+            case 'm': megabytes = atoi(optarg); break;
+            case 'w': ctx.workdir = optarg; break;
+            case 'o': path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (!ctx.threads) { ctx.threads = 1; }
+    ctx.run_keys = std::max<size_t>(0x10000, megabytes * 0x100000 / sizeof(u64) / ctx.threads);
+
+    string visited = ctx.workdir + "/visited.0";
+    string frontier = ctx.workdir + "/frontier.0";
+    ply_stats total = {};
+    u64 count = 0;
+    {
+        key_writer w, all;
+        writer_open(w, frontier);
+        writer_open(all, visited);
+        ply_stats stats = {};
+        for (u64 k : opening_keys()) {
+            writer_put(w, k);
+            writer_put(all, k);
+            count_key(stats, k);
+        }
+        writer_close(w);
+        writer_close(all);
+        total = stats;
+        count = stats.states;
+        print_stats("ply 0", stats);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (u32 ply = 1; ply <= max_plies && count; ++ply) {
+        expand(ctx, frontier, count);
+        ply_stats stats = {};
+        string next_visited = ctx.workdir + "/visited." + std::to_string(ply % 2);
+        merge_runs(ctx, visited, next_visited, frontier, stats);
+        unlink(visited.c_str());
+        visited = next_visited;
+        count = stats.states;
+
+        total.states += stats.states;
+        total.terminal += stats.terminal;
+        for (u32 a = 0; a < 5; ++a) {
+            for (u32 b = 0; b < 5; ++b) {
+                total.classes[a][b] += stats.classes[a][b];
+            }
+        }
+        chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+        char label[64];
+        snprintf(label, sizeof(label), "ply %u (%.1fs)", ply, elapsed.count());
+        print_stats(label, stats);
+    }
+    print_stats("total", total);
+
+    write_compact(visited, path, total.states);
+    unlink(visited.c_str());
+    unlink(frontier.c_str());
+    return 0;
+}
@@ -0,0 +1,387 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "book.h"
+#include "engine.h"
+
+
+// Searches of many games on a few threads. A search runs SCHED_SLICE
+// playouts at a time on a warm tree and goes back to a queue between
+// slices. Every worker has a queue ordered earliest deadline first; it
+// runs the most urgent search of its own, or steals one from another
+// worker whose search is due sooner.
+//
+// The deadline a search is queued under is that of its next slice: a
+// search with the default time limit is owed one core from its arrival,
+// one with half the time two, so the next slice is due once that core
+// would have run the slices done so far. Under load every search falls
+// behind its pace alike. A search ends at its own deadline, when its
+// budget is spent, or once the runner up can no longer catch the best
+// move in the time left; the core then goes to the next search due. More
+// games than cores make each search shallower, none of them late. A
+// search whose client has gone ends at its next slice.
+//
+// A session is a search tree kept between moves. A search takes the
+// session whose tree already holds its position, so a game keeps its tree
+// from move to move without having to name itself. With a network the
+// search is puct_move's, on a tree of the search's own that goes with it.
+
+
+#define SCHED_SLICE 256
+// a worker keeps to its own queue unless another one is due this much sooner
+#define SCHED_STEAL_SLACK 0.002
+
+
+typedef chrono::steady_clock::time_point sched_time;
+
+
+typedef struct {
+    monte_tree tree;
+    u64 used;
+    u8 busy;
+} sched_session;
+
+
+typedef struct sched_task {
+    game_state state;
+    sched_time start;
+    sched_time deadline;
+    sched_time due; // of the next slice
+    r64 pace; // core seconds owed per second
+    r64 served; // core seconds
+    sched_session* session; // null when every session was busy
+    monte_tree local;
+    puct_tree puct; // with a network
+    u32 playouts;
+    u32 slices;
+    player_move move;
+    r64 score;
+    search_metrics metrics;
+    root_halving halving; // kept from slice to slice
+    amaf_table amaf; // likewise
+    std::default_random_engine rng; // with Seed, the search's own stream
+    std::function<void(sched_task&)> done; // called on the worker, which then deletes the task
+    std::function<void(sched_task&)> progress; // when given, after every slice but the last
+    std::shared_ptr<std::atomic<u8>> abandoned; // set once no one waits for the move, ends it next slice
+} sched_task;
+
+
+typedef struct {
+    std::mutex lock;
+    vector<sched_task*> tasks; // heap, earliest due on top
+    std::atomic<i64> due; // of the top, max when empty
+} sched_queue;
+
+
+typedef struct {
+    u32 threads;
+    u32 sessions;
+    u32 session_nodes; // a bigger tree starts over
+    r64 time_limit; // the default, owed one core
+    u32 playouts;
+    u32 nodes;
+    u32 dive_limit;
+    u8 halving; // root moves by sequential halving over the playouts
+    const opening_book* book;
+} sched_config;
+
+
+typedef struct {
+    sched_config config;
+    vector<sched_queue> queues;
+    std::atomic<u32> next_queue;
+    std::atomic<u32> pending;
+    std::mutex lock; // sessions, and sleeping while nothing is pending
+    std::condition_variable ready;
+    vector<sched_session> sessions;
+    u64 clock;
+} sched_state;
+
+
+static inline
+u8
+sched_earlier(const sched_task* a, const sched_task* b) {
+    return a->due < b->due;
+}
+
+
+static inline
+i64
+sched_due(sched_queue& q) {
+    if (q.tasks.empty()) { return INT64_MAX; }
+    return q.tasks.front()->due.time_since_epoch().count();
+}
+
+
+static
+void
+sched_push(sched_state& s, u32 queue, sched_task* task) {
+    auto& q = s.queues[queue];
+    std::lock_guard<std::mutex> guard(q.lock);
+    q.tasks.push_back(task);
+    std::push_heap(q.tasks.begin(), q.tasks.end(), [](auto a, auto b) { return sched_earlier(b, a); });
+    q.due = sched_due(q);
+}
+
+
+static
+sched_task*
+sched_pop(sched_state& s, u32 queue) {
+    auto& q = s.queues[queue];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty()) { return nullptr; }
+    std::pop_heap(q.tasks.begin(), q.tasks.end(), [](auto a, auto b) { return sched_earlier(b, a); });
+    auto task = q.tasks.back();
+    q.tasks.pop_back();
+    q.due = sched_due(q);
+    return task;
+}
+
+
+// the most urgent search, own queue first; waits while there is none
+static
+sched_task*
+sched_take(sched_state& s, u32 self) {
+    i64 slack = chrono::duration_cast<sched_time::duration>(chrono::duration<r64>(SCHED_STEAL_SLACK)).count();
+    for (;;) {
+        u32 best = self;
+        i64 due = s.queues[self].due;
+        for (u32 i = 0; i < s.queues.size(); ++i) {
+            i64 d = s.queues[i].due;
+            if (i != self && d < INT64_MAX && (due == INT64_MAX || d + slack < due)) {
+                best = i;
+                due = d;
+            }
+        }
+        if (due != INT64_MAX) {
+            // another worker may have got there first
+            if (auto task = sched_pop(s, best)) {
+                s.pending -= 1;
+                return task;
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(s.lock);
+        s.ready.wait(guard, [&]() { return s.pending > 0; });
+    }
+}
+
+
+// a session already holding the position, or the least recently used free
+// one started over; null when all are busy
+static
+sched_session*
+sched_session_take(sched_state& s, u64 key) {
+    std::unique_lock<std::mutex> guard(s.lock);
+    sched_session* warm = nullptr;
+    sched_session* oldest = nullptr;
+    u32 warm_rounds = 0;
+    for (auto& session : s.sessions) {
+        if (session.busy) { continue; }
+        auto it = session.tree.find(key);
+        if (it != session.tree.end() && it->second.rounds > warm_rounds) {
+            warm = &session;
+            warm_rounds = it->second.rounds;
+        }
+        if (!oldest || session.used < oldest->used) { oldest = &session; }
+    }
+    sched_session* session = warm ? warm : oldest;
+    if (!session) { return nullptr; }
+    session->busy = 1;
+    guard.unlock();
+    if (!warm || session->tree.size() > s.config.session_nodes) {
+        session->tree.clear();
+    }
+    return session;
+}
+
+
+static
+void
+sched_session_release(sched_state& s, sched_session* session) {
+    if (!session) { return; }
+    std::lock_guard<std::mutex> guard(s.lock);
+    session->busy = 0;
+    session->used = ++s.clock;
+}
+
+
+// the tree task searches on
+static inline
+monte_tree&
+sched_tree(sched_task& task) {
+    return task.session ? task.session->tree : task.local;
+}
+
+
+// a search for state, answered through done by its deadline
+static
+void
+sched_submit(sched_state& s, const game_state& state, r64 time_limit, std::function<void(sched_task&)> done,
+    std::function<void(sched_task&)> progress = nullptr, std::shared_ptr<std::atomic<u8>> abandoned = nullptr) {
+    auto task = new sched_task();
+    task->state = state;
+    task->start = chrono::steady_clock::now();
+    task->deadline = task->start + chrono::duration_cast<sched_time::duration>(chrono::duration<r64>(time_limit));
+    task->due = task->start;
+    task->pace = time_limit > 0 ? s.config.time_limit / time_limit : 1e6;
+    task->move = player_pass;
+    task->metrics = {.engine=Network.header ? "puct" : "monte"};
+    task->done = std::move(done);
+    task->progress = std::move(progress);
+    task->abandoned = std::move(abandoned);
+    s.pending += 1;
+    sched_push(s, s.next_queue++ % s.queues.size(), task);
+    { std::lock_guard<std::mutex> guard(s.lock); }
+    s.ready.notify_one();
+}
+
+
+static
+void
+sched_add_metrics(search_metrics& m, const search_metrics& slice) {
+    m.engine = slice.engine;
+    m.max_depth = std::max(m.max_depth, slice.max_depth);
+    m.dives += slice.dives;
+    m.dive_plies += slice.dive_plies;
+    m.select_seconds += slice.select_seconds;
+    m.leaf_seconds += slice.leaf_seconds;
+    m.backup_seconds += slice.backup_seconds;
+    // the tree is kept from slice to slice, so the last one has it all
+    m.root_count = slice.root_count;
+    std::copy(slice.root, slice.root + slice.root_count, m.root);
+}
+
+
+// one slice of task's search; 1 once the search is over
+static
+u8
+sched_slice(sched_state& s, sched_task& task) {
+    auto& config = s.config;
+    if (task.state.ended || (task.abandoned && *task.abandoned)) { return 1; }
+    if (!task.slices && book_probe(*config.book, task.state, &task.move)) { return 1; }
+    if (!task.slices && tb_probe_move(Tablebase, task.state, &task.move, &task.score)) { return 1; }
+    Deadline = task.deadline;
+    task.slices += 1;
+    // a seeded search is seeded once and keeps its stream between slices,
+    // whichever thread runs them
+    if (Seed) {
+        if (task.slices == 1) { search_seed(task.state); }
+        else { Rng = task.rng; }
+    }
+    if (task.slices == 1 && !Network.header) {
+        task.session = sched_session_take(s, pack_state(task.state).v);
+        if (RootHalving) {
+            root_halving_init(task.halving, valid_moves(task.state, task.state.current_player).size(), config.playouts);
+        }
+    }
+    PlayoutLimit = SCHED_SLICE;
+    if (config.playouts) { PlayoutLimit = std::min(PlayoutLimit, config.playouts - task.playouts); }
+    NodeLimit = config.nodes;
+    vector<u32> visits;
+    auto start = chrono::steady_clock::now();
+    u64 before = Playouts;
+    if (Network.header) {
+        task.move = puct_move(task.state, 0, &task.score, &visits, &task.puct);
+    }
+    else {
+        task.move = monte_move(task.state, 0, &task.score, &visits, &sched_tree(task), &task.halving, &task.amaf);
+    }
+    if (Seed) { task.rng = Rng; }
+    u32 played = Playouts - before;
+    auto now = chrono::steady_clock::now();
+    task.served += chrono::duration<r64>(now - start).count();
+    task.due = std::min(task.deadline, task.start +
+        chrono::duration_cast<sched_time::duration>(chrono::duration<r64>(task.served / task.pace)));
+    task.playouts += played;
+    sched_add_metrics(task.metrics, Metrics);
+    task.metrics.share = task.playouts ? Metrics.share * played / task.playouts : 0;
+
+    if (task.move.v == player_pass.v || now >= task.deadline) { return 1; }
+    if (config.playouts && task.playouts >= config.playouts) { return 1; }
+    if (config.nodes && (Network.header ? task.puct.size() : sched_tree(task).size()) >= config.nodes) { return 1; }
+    // the halving's pick is not the most visited move, it runs to the end
+    if (RootHalving && !Network.header) { return 0; }
+    // settled: the playouts left at this rate cannot move the most visited
+    // root move from the top
+    std::partial_sort(visits.begin(), visits.begin() + std::min<size_t>(2, visits.size()), visits.end(), std::greater<u32>());
+    u32 lead = visits.size() > 1 ? visits[0] - visits[1] : visits.empty() ? 0 : visits[0];
+    r64 rate = played / std::max(chrono::duration<r64>(now - start).count(), 1e-6);
+    return lead > rate * chrono::duration<r64>(task.deadline - now).count();
+}
+
+
+// the search so far, as a snapshot of its tree
+static
+void
+sched_snapshot(sched_task& task, search_snapshot& snapshot) {
+    if (Network.header) { puct_snapshot(task.state, task.puct, snapshot); }
+    else { monte_snapshot(task.state, sched_tree(task), snapshot); }
+    snapshot.playouts = task.playouts;
+}
+
+
+// the search's record, as monte_move would have written it in one go
+static
+void
+sched_report(sched_task& task) {
+    if (!Telemetry) { return; }
+    auto& m = task.metrics;
+    m.playouts = task.playouts;
+    m.seconds = chrono::duration<r64>(chrono::steady_clock::now() - task.start).count();
+    if (task.slices) {
+        if (Network.header) { metrics_table(m, task.puct); }
+        else { metrics_table(m, sched_tree(task)); }
+    }
+    m.move = task.move;
+    m.score = task.score;
+    metrics_write(Telemetry, m);
+}
+
+
+static
+void
+sched_worker(sched_state& s, u32 self) {
+    DiveLimit = s.config.dive_limit;
+    // halving needs the whole budget up front, a playout budget
+    RootHalving = s.config.halving && s.config.playouts;
+    Sliced = 1;
+    for (;;) {
+        auto task = sched_take(s, self);
+        if (!sched_slice(s, *task)) {
+            if (task->progress) { task->progress(*task); }
+            s.pending += 1;
+            sched_push(s, self, task);
+            continue;
+        }
+        Deadline = sched_time::max();
+        sched_report(*task);
+        sched_session_release(s, task->session);
+        task->done(*task);
+        delete task;
+    }
+}
+
+
+static
+void
+sched_start(sched_state& s, const sched_config& config) {
+    s.config = config;
+    s.queues = vector<sched_queue>(config.threads);
+    for (auto& q : s.queues) { q.due = INT64_MAX; }
+    s.next_queue = 0;
+    s.pending = 0;
+    // sessions beyond the threads hold the trees of games between moves
+    s.sessions.resize(std::max(config.sessions, config.threads));
+    s.clock = 0;
+    for (u32 t = 0; t < config.threads; ++t) {
+        std::thread(sched_worker, std::ref(s), t).detach();
+    }
+}
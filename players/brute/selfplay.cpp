@@ -0,0 +1,206 @@
+// cc -std=c++20 -lc++ -O3 -pthread -o selfplay selfplay.cpp
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "engine.h"
+#include "selfplay.h"
+
+
+using std::vector;
+
+
+typedef player_move (*search_engine)(const game_state&, r64, r64*, vector<u32>*);
+
+
+typedef struct {
+    u32 games;
+    r64 time_limit;
+    u32 opening_plies;
+    u32 max_moves;
+    search_engine engine;
+} selfplay_config;
+
+
+typedef struct {
+    game_state state;
+    vector<u32> visits;
+} selfplay_position;
+
+
+static
+u32
+play_game(const selfplay_config& config, std::default_random_engine& rng, sp_writer& out) {
+    auto state = random_opening(rng, config.opening_plies);
+    vector<selfplay_position> positions;
+    for (u32 moves = 0; !state.ended && moves < config.max_moves; ++moves) {
+        vector<u32> visits;
+        auto mv = config.engine(state, config.time_limit, nullptr, &visits);
+        if (mv.v == player_pass.v) { break; }
+        positions.push_back({state, visits});
+        state = next_state(state, mv);
+    }
+    for (auto& p : positions) {
+        i8 result = 0;
+        if (state.ended) {
+            result = p.state.current_player == state.current_player ? 1 : -1;
+        }
+        if (!sp_append(out, p.state, result, p.visits)) { return 0; }
+    }
+    return positions.size();
+}
+
+
+static
+int
+generate(const selfplay_config& config, const char* output, u32 threads) {
+    std::atomic<u32> next(0);
+    std::atomic<u64> positions(0);
+    std::atomic<u8> failed(0);
+    std::mutex lock;
+    auto start = chrono::steady_clock::now();
+    vector<std::thread> workers;
+    for (u32 t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            std::default_random_engine rng(std::random_device{}());
+            sp_writer out;
+            if (!sp_writer_open(out, output)) {
+                failed = 1;
+                return;
+            }
+            for (u32 game; !failed && (game = next.fetch_add(1)) < config.games; ) {
+                u32 n = play_game(config, rng, out);
+                if (!n) { continue; }
+                u64 total = positions += n;
+                chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+                std::lock_guard<std::mutex> guard(lock);
+                fprintf(stderr, "game %u: %u positions, %" PRIu64 " total, %.0f/hour\n",
+                    game + 1, n, total, total * 3600 / elapsed.count());
+            }
+            sp_writer_close(out);
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+    return failed;
+}
+
+
+static
+void
+print_record(const sp_record& record, const u8* visits) {
+    packed_state packed = {.v=record.state};
+    auto state = unpack_state(packed);
+    auto valid = valid_moves(state, state.current_player);
+    printf("%016" PRIx64 " %+d", record.state, record.result);
+    for (u32 i = 0; i < record.count && i < valid.size(); ++i) {
+        u16 v;
+        memcpy(&v, visits + 2 * i, 2);
+        if (!v) { continue; }
+        printf(" %02u-%02u(%u):%.3f", valid[i].from, valid[i].to, valid[i].pid, v / 65535.0);
+    }
+    printf("\n");
+}
+
+
+// prints every record, or a uniform sample of them
+static
+int
+replay(const char* path, u32 sample) {
+    sp_file file;
+    if (!sp_open(file, path)) { return 1; }
+    std::default_random_engine rng(std::random_device{}());
+    vector<std::pair<sp_record, const u8*>> reservoir;
+    sp_cursor cursor = {};
+    sp_record record;
+    const u8* visits;
+    u64 count = 0, wins = 0, losses = 0;
+    while (sp_next(file, cursor, &record, &visits)) {
+        ++count;
+        wins += record.result > 0;
+        losses += record.result < 0;
+        if (!sample) {
+            print_record(record, visits);
+        }
+        else if (reservoir.size() < sample) {
+            reservoir.push_back({record, visits});
+        }
+        else {
+            u64 i = std::uniform_int_distribution<u64>(0, count-1)(rng);
+            if (i < sample) { reservoir[i] = {record, visits}; }
+        }
+    }
+    for (auto& p : reservoir) {
+        print_record(p.first, p.second);
+    }
+    fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " won, %" PRIu64 " lost, %" PRIu64 " cut off\n",
+        count, wins, losses, count - wins - losses);
+    sp_close(file);
+    return 0;
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-g games] [-t seconds] [-j threads] [-e engine] [-n network] [-p plies] [-m moves] [-o file]\n", name);
+    fprintf(stderr, "       %s -r file [-s sample]\n", name);
+    fprintf(stderr, "  -g  games to play (default 100)\n");
+    fprintf(stderr, "  -t  search time per move (default 0.1)\n");
+    fprintf(stderr, "  -j  parallel games (default: all cores)\n");
+    fprintf(stderr, "  -e  monte or puct (default monte, puct needs -n)\n");
+    fprintf(stderr, "  -p  random plies after the opening (default 4)\n");
+    fprintf(stderr, "  -m  moves before a game is cut off (default 200)\n");
+    fprintf(stderr, "  -o  records are appended here (default selfplay.sp)\n");
+    fprintf(stderr, "  -r  print the records of a file\n");
+    fprintf(stderr, "  -s  print only a random sample of this many\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    selfplay_config config = {
+        .games=100, .time_limit=0.1, .opening_plies=4, .max_moves=200, .engine=monte_move,
+    };
+    u32 threads = std::thread::hardware_concurrency();
+    const char* output = "selfplay.sp";
+    const char* input = nullptr;
+    u32 sample = 0;
+    for (int opt; (opt = getopt(argc, argv, "g:t:j:e:n:p:m:o:r:s:h")) != -1; ) {
+        switch (opt) {
+            case 'g': config.games = atoi(optarg); break;
+            case 't': config.time_limit = atof(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'e':
+                if (!strcmp(optarg, "monte")) { config.engine = monte_move; }
+                else if (!strcmp(optarg, "puct")) { config.engine = puct_move; }
+                else { usage(argv[0]); return 1; }
+                break;
+            case 'n':
+                if (!nn_open(Network, optarg)) { return 1; }
+                break;
+            case 'p': config.opening_plies = atoi(optarg); break;
+            case 'm': config.max_moves = atoi(optarg); break;
+            case 'o': output = optarg; break;
+            case 'r': input = optarg; break;
+            case 's': sample = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (input) {
+        return replay(input, sample);
+    }
+    if (config.engine == search_engine(puct_move) && !Network.header) {
+        fprintf(stderr, "puct needs a network, -n\n");
+        return 1;
+    }
+    if (!threads) { threads = 1; }
+    Verbose = 0;
+    return generate(config, output, threads);
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game.h"
+
+
+// Self-play records. A file is sp_header followed by chunks, each an
+// sp_chunk and then `bytes` of records; writers append whole chunks with
+// O_APPEND, so any number of them can share one file.
+//
+// A record is sp_record and then u16 visits[count]: search effort per
+// legal move, in valid_moves(unpack_state(state)) order, scaled to add up
+// to about 65535. result is for the side to move: 1 won, -1 lost, 0 the
+// game was cut off.
+
+
+#define SP_MAGIC "MPSP"
+#define SP_VERSION 1
+#define SP_CHUNK 0x10000
+
+
+typedef struct {
+    char magic[4];
+    u32 version;
+} sp_header;
+
+
+typedef struct {
+    u32 bytes;
+    u32 records;
+} sp_chunk;
+
+
+typedef struct __attribute__((packed)) {
+    u64 state;
+    i8 result;
+    u8 count;
+} sp_record;
+
+
+typedef struct {
+    int fd;
+    vector<u8> buffer;
+    u32 records;
+} sp_writer;
+
+
+typedef struct {
+    const u8* data;
+    size_t size;
+} sp_file;
+
+
+typedef struct {
+    size_t pos;
+    size_t end;
+} sp_cursor;
+
+
+static
+u8
+sp_writer_open(sp_writer& w, const char* path) {
+    w.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (w.fd < 0) {
+        perror(path);
+        return 0;
+    }
+    flock(w.fd, LOCK_EX);
+    struct stat st;
+    if (!fstat(w.fd, &st) && !st.st_size) {
+        sp_header header = {};
+        memcpy(header.magic, SP_MAGIC, 4);
+        header.version = SP_VERSION;
+        if (write(w.fd, &header, sizeof(header)) != sizeof(header)) {
+            perror(path);
+        }
+    }
+    flock(w.fd, LOCK_UN);
+    w.buffer.reserve(sizeof(sp_chunk) + SP_CHUNK);
+    w.buffer.resize(sizeof(sp_chunk));
+    w.records = 0;
+    return 1;
+}
+
+
+static
+u8
+sp_flush(sp_writer& w) {
+    if (!w.records) { return 1; }
+    sp_chunk chunk = {.bytes=u32(w.buffer.size() - sizeof(sp_chunk)), .records=w.records};
+    memcpy(w.buffer.data(), &chunk, sizeof(chunk));
+    ssize_t n = write(w.fd, w.buffer.data(), w.buffer.size());
+    w.buffer.resize(sizeof(sp_chunk));
+    w.records = 0;
+    if (n != ssize_t(sizeof(chunk) + chunk.bytes)) {
+        perror("write");
+        return 0;
+    }
+    return 1;
+}
+
+
+// visits are in valid_moves(state) order, state as played
+static
+u8
+sp_append(sp_writer& w, const game_state& state, i8 result, const vector<u32>& visits) {
+    auto packed = pack_state(state);
+    auto valid = valid_moves(state, state.current_player);
+    auto order = valid_moves(unpack_state(packed), state.current_player);
+    u64 total = 0;
+    for (u32 v : visits) { total += v; }
+    size_t size = sizeof(sp_record) + 2 * order.size();
+    if (w.buffer.size() + size > sizeof(sp_chunk) + SP_CHUNK && !sp_flush(w)) { return 0; }
+    sp_record record = {.state=packed.v, .result=result, .count=u8(order.size())};
+    auto p = w.buffer.size();
+    w.buffer.resize(p + size);
+    memcpy(&w.buffer[p], &record, sizeof(record));
+    p += sizeof(record);
+    for (auto& mv : order) {
+        u16 v = 0;
+        for (u32 i = 0; i < valid.size() && total; ++i) {
+            if (valid[i].from == mv.from && valid[i].to == mv.to && valid[i].pid == mv.pid) {
+                v = u64(visits[i]) * 65535 / total;
+                break;
+            }
+        }
+        memcpy(&w.buffer[p], &v, 2);
+        p += 2;
+    }
+    w.records += 1;
+    return 1;
+}
+
+
+static
+void
+sp_writer_close(sp_writer& w) {
+    sp_flush(w);
+    if (w.fd >= 0) { close(w.fd); }
+    w.fd = -1;
+}
+
+
+static
+u8
+sp_open(sp_file& file, const char* path) {
+    file = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || size_t(st.st_size) < sizeof(sp_header)) {
+        fprintf(stderr, "%s: not a self-play file\n", path);
+        close(fd);
+        return 0;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+    auto header = (const sp_header*) p;
+    if (memcmp(header->magic, SP_MAGIC, 4) || header->version != SP_VERSION) {
+        fprintf(stderr, "%s: not a self-play file\n", path);
+        munmap(p, st.st_size);
+        return 0;
+    }
+    file.data = (const u8*) p;
+    file.size = st.st_size;
+    return 1;
+}
+
+
+static
+void
+sp_close(sp_file& file) {
+    if (file.data) {
+        munmap((void*) file.data, file.size);
+    }
+    file = {};
+}
+
+
+// next record after cursor, which starts zeroed; 0 at the end of the file
+// or at a chunk cut short by a writer that died mid-write
+static
+u8
+sp_next(const sp_file& file, sp_cursor& cursor, sp_record* record, const u8** visits) {
+    if (!cursor.pos) {
+        cursor.pos = cursor.end = sizeof(sp_header);
+    }
+    if (cursor.pos >= cursor.end) {
+        if (cursor.end + sizeof(sp_chunk) > file.size) { return 0; }
+        sp_chunk chunk;
+        memcpy(&chunk, file.data + cursor.end, sizeof(chunk));
+        cursor.pos = cursor.end + sizeof(chunk);
+        cursor.end = cursor.pos + chunk.bytes;
+        if (cursor.end > file.size || cursor.pos == cursor.end) { return 0; }
+    }
+    if (cursor.pos + sizeof(sp_record) > cursor.end) { return 0; }
+    memcpy(record, file.data + cursor.pos, sizeof(sp_record));
+    *visits = file.data + cursor.pos + sizeof(sp_record);
+    cursor.pos += sizeof(sp_record) + 2 * record->count;
+    return cursor.pos <= cursor.end;
+}
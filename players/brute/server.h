@@ -0,0 +1,424 @@
+#pragma once
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "book.h"
+#include "engine.h"
+#include "scheduler.h"
+
+
+// player.py's protocol served by brute itself: POST hackerchess/move with
+// {currentPlayer, board, progs} answers [from, to, pid]; an optional
+// timeLimit in ms sets the request's deadline, counted from its arrival.
+// One thread runs an epoll loop over every connection, the searches run
+// on the scheduler's threads.
+//
+// With Accept: text/event-stream the answer is a stream of server-sent
+// events instead: a snapshot event every SERVER_SNAPSHOT_INTERVAL with
+// the search so far (snapshot_json), then a move event with the move.
+// A client may take a snapshot's move and hang up, which ends the search.
+
+
+#define SERVER_MAX_REQUEST 0x10000
+#define SERVER_SNAPSHOT_INTERVAL 0.1
+
+
+typedef struct {
+    u16 port;
+    u32 threads;
+    u32 sessions;
+    u32 session_nodes; // a bigger tree starts over
+    r64 time_limit;
+    u32 playouts;
+    u32 nodes;
+    u32 dive_limit;
+    u8 halving;
+    const opening_book* book;
+} server_config;
+
+
+typedef struct {
+    u64 connection;
+    std::string response;
+    u8 last; // of the request's answer
+} server_reply;
+
+
+typedef struct {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t sent;
+    u8 busy; // a search runs for it, later requests wait
+    u8 close; // once out is sent
+    std::shared_ptr<std::atomic<u8>> abandoned; // of the search running for it
+} server_connection;
+
+
+typedef struct {
+    server_config config;
+    int wake; // eventfd, replies are waiting
+    std::mutex lock;
+    std::deque<server_reply> replies;
+    sched_state scheduler;
+} server_state;
+
+
+// the integers under key, a number or an array of count of them
+static
+u8
+json_ints(const std::string& json, const char* key, i32* out, u32 count) {
+    std::string quoted = std::string("\"") + key + "\"";
+    size_t p = json.find(quoted);
+    if (p == std::string::npos) { return 0; }
+    const char* s = json.c_str() + p + quoted.size();
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') { ++s; }
+    if (*s++ != ':') { return 0; }
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') { ++s; }
+    u8 list = *s == '[';
+    if (list) { ++s; }
+    else if (count != 1) { return 0; }
+    for (u32 i = 0; i < count; ++i) {
+        char* end;
+        long x = strtol(s, &end, 10);
+        if (end == s) { return 0; }
+        out[i] = x;
+        s = end;
+        while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') { ++s; }
+        if (list && *s++ != (i + 1 < count ? ',' : ']')) { return 0; }
+    }
+    return 1;
+}
+
+
+static
+u8
+server_parse_state(const std::string& body, game_state& state) {
+    i32 player, board[25], progs[5];
+    if (!json_ints(body, "currentPlayer", &player, 1) || !json_ints(body, "board", board, 25) ||
+        !json_ints(body, "progs", progs, 5)) {
+        return 0;
+    }
+    if (player != 1 && player != 2) { return 0; }
+    state = {};
+    state.current_player = player;
+    // every piece at most once, both kings on the board
+    u32 pieces = 0;
+    for (u32 i = 0; i < 25; ++i) {
+        i32 piece = board[i];
+        if (!piece) { continue; }
+        if (!(piece >= 11 && piece <= 15) && !(piece >= 21 && piece <= 25)) { return 0; }
+        if (pieces & (1 << piece)) { return 0; }
+        pieces |= 1 << piece;
+        state.pieces[i] = piece;
+    }
+    if (!(pieces & (1 << 13)) || !(pieces & (1 << 23))) { return 0; }
+    u32 seen = 0;
+    for (u32 i = 0; i < 5; ++i) {
+        if (progs[i] < 0 || progs[i] > 4 || (seen & (1 << progs[i]))) { return 0; }
+        seen |= 1 << progs[i];
+        state.progs[i] = progs[i];
+    }
+    state.ended = is_terminal(state);
+    state.win = state.ended;
+    return 1;
+}
+
+
+static
+std::string
+http_response(u32 status, const char* reason, const char* headers, const std::string& body, u8 close) {
+    char head[512];
+    snprintf(head, sizeof(head), "HTTP/1.1 %u %s\r\n%sContent-Length: %zu\r\n%s\r\n",
+        status, reason, headers, body.size(), close ? "Connection: close\r\n" : "");
+    return head + body;
+}
+
+
+// a server-sent event as one chunk of a chunked body
+static
+std::string
+http_event(const char* event, const char* data) {
+    char head[16];
+    std::string chunk = std::string("event: ") + event + "\ndata: " + data + "\n\n";
+    snprintf(head, sizeof(head), "%zx\r\n", chunk.size());
+    return head + chunk + "\r\n";
+}
+
+
+// from a search thread to the epoll loop
+static
+void
+server_post(server_state& server, u64 connection, std::string response, u8 last) {
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        server.replies.push_back({connection, std::move(response), last});
+    }
+    u64 one = 1;
+    write(server.wake, &one, sizeof(one));
+}
+
+
+// the search's move as the reply of its connection
+static
+void
+server_answer(server_state& server, u64 connection, u8 close, u8 stream, const sched_task& task) {
+    chrono::duration<r64> elapsed = chrono::steady_clock::now() - task.start;
+    char body[32] = "null";
+    if (task.move.v != player_pass.v) {
+        snprintf(body, sizeof(body), "[%u,%u,%u]", task.move.from, task.move.to, task.move.pid);
+    }
+    fprintf(stderr, "player move %s, %.2f s, %u slices\n", body, elapsed.count(), task.slices);
+    if (stream) {
+        server_post(server, connection, http_event("move", body) + "0\r\n\r\n", 1);
+        return;
+    }
+    server_post(server, connection, http_response(200, "OK",
+        "Access-Control-Allow-Origin: *\r\nCache-Control: no-cache\r\nContent-Type: application/json\r\n",
+        body, close), 1);
+}
+
+
+// the search so far as a snapshot event, once an interval
+static
+void
+server_progress(server_state& server, u64 connection, sched_time& next, sched_task& task) {
+    auto now = chrono::steady_clock::now();
+    if (now < next) { return; }
+    next = now + chrono::duration_cast<sched_time::duration>(chrono::duration<r64>(SERVER_SNAPSHOT_INTERVAL));
+    search_snapshot snapshot;
+    sched_snapshot(task, snapshot);
+    snapshot.seconds = chrono::duration<r64>(now - task.start).count();
+    char data[512];
+    snapshot_json(data, sizeof(data), snapshot);
+    server_post(server, connection, http_event("snapshot", data), 0);
+}
+
+
+static
+void
+server_flush(int epoll, u64 id, server_connection& c) {
+    while (c.sent < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { break; }
+            c.close = 1;
+            c.out.clear();
+            c.sent = 0;
+            return;
+        }
+        c.sent += n;
+    }
+    if (c.sent == c.out.size()) {
+        c.out.clear();
+        c.sent = 0;
+    }
+    epoll_event ev = {.events=c.out.empty() ? u32(EPOLLIN) : u32(EPOLLIN | EPOLLOUT), .data={.u64=id}};
+    epoll_ctl(epoll, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+
+// takes one request off the front of c.in, either answering it or handing
+// it to the search threads; 0 while it is incomplete
+static
+u8
+server_request(server_state& server, u64 id, server_connection& c) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (c.in.size() > SERVER_MAX_REQUEST) {
+            c.out += http_response(431, "Request Header Fields Too Large", "", "", 1);
+            c.close = 1;
+        }
+        return 0;
+    }
+    // the request line as it is, header names and values lowercased
+    std::string head = c.in.substr(0, end);
+    size_t line = head.find('\n');
+    std::string headers = line == std::string::npos ? "" : head.substr(line);
+    for (auto& ch : headers) {
+        if (ch >= 'A' && ch <= 'Z') { ch += 'a' - 'A'; }
+    }
+    size_t length = 0;
+    size_t p = headers.find("\ncontent-length:");
+    if (p != std::string::npos) {
+        length = strtoul(headers.c_str() + p + 16, nullptr, 10);
+    }
+    if (length > SERVER_MAX_REQUEST) {
+        c.out += http_response(413, "Content Too Large", "", "", 1);
+        c.close = 1;
+        return 0;
+    }
+    if (c.in.size() < end + 4 + length) { return 0; }
+    std::string body = c.in.substr(end + 4, length);
+    c.in.erase(0, end + 4 + length);
+
+    u8 close = headers.find("\nconnection: close") != std::string::npos ||
+        (head.find(" HTTP/1.0\r") != std::string::npos && headers.find("\nconnection: keep-alive") == std::string::npos);
+    c.close = close;
+    if (!head.compare(0, 8, "OPTIONS ")) {
+        c.out += http_response(204, "No Content",
+            "Allow: OPTIONS, POST\r\nAccess-Control-Allow-Origin: *\r\n"
+            "Access-Control-Allow-Methods: OPTIONS, POST\r\nAccess-Control-Allow-Headers: Content-Type\r\n",
+            "", close);
+        return 1;
+    }
+    if (head.compare(0, 5, "POST ")) {
+        c.out += http_response(405, "Method Not Allowed", "Allow: OPTIONS, POST\r\n", "", close);
+        return 1;
+    }
+    game_state state;
+    if (!server_parse_state(body, state)) {
+        c.out += http_response(400, "Bad Request", "Access-Control-Allow-Origin: *\r\n", "", close);
+        return 1;
+    }
+    i32 ms = 0;
+    r64 time_limit = json_ints(body, "timeLimit", &ms, 1) && ms > 0 ? ms / 1000.0 : server.config.time_limit;
+    u8 stream = headers.find("\naccept: text/event-stream") != std::string::npos;
+    c.busy = 1;
+    c.abandoned = std::make_shared<std::atomic<u8>>(0);
+    std::function<void(sched_task&)> progress;
+    if (stream) {
+        c.out += "HTTP/1.1 200 OK\r\nAccess-Control-Allow-Origin: *\r\nCache-Control: no-cache\r\n"
+            "Content-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n";
+        c.out += close ? "Connection: close\r\n\r\n" : "\r\n";
+        progress = [&server, id, next = chrono::steady_clock::now()](sched_task& task) mutable {
+            server_progress(server, id, next, task);
+        };
+    }
+    sched_submit(server.scheduler, state, time_limit, [&server, id, close, stream](sched_task& task) {
+        server_answer(server, id, close, stream, task);
+    }, progress, c.abandoned);
+    return 1;
+}
+
+
+// answers what can be answered; 0 once the connection is to be closed
+static
+u8
+server_serve(server_state& server, int epoll, u64 id, server_connection& c) {
+    while (!c.busy && !c.close && server_request(server, id, c)) {}
+    server_flush(epoll, id, c);
+    return !(c.close && !c.busy && c.out.empty());
+}
+
+
+static
+int
+serve(const server_config& config) {
+    int listener = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 1;
+    }
+    int on = 1, off = 0;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    sockaddr_in6 addr = {.sin6_family=AF_INET6, .sin6_port=htons(config.port), .sin6_addr=in6addr_any};
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, SOMAXCONN)) {
+        perror("listen");
+        close(listener);
+        return 1;
+    }
+
+    server_state server;
+    server.config = config;
+    server.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    // ids 0 and 1 are the listener and the wake up, connections count from 2
+    epoll_event ev = {.events=EPOLLIN, .data={.u64=0}};
+    epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &ev);
+    ev = {.events=EPOLLIN, .data={.u64=1}};
+    epoll_ctl(epoll, EPOLL_CTL_ADD, server.wake, &ev);
+
+    Verbose = 0;
+    sched_config scheduler = {
+        .threads=config.threads, .sessions=config.sessions, .session_nodes=config.session_nodes,
+        .time_limit=config.time_limit,
+        .playouts=config.playouts, .nodes=config.nodes, .dive_limit=config.dive_limit, .halving=config.halving,
+        .book=config.book,
+    };
+    sched_start(server.scheduler, scheduler);
+    fprintf(stderr, "listening on port %u, %u search threads\n", config.port, config.threads);
+
+    unordered_map<u64, server_connection> connections;
+    u64 next_id = 2;
+    epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(epoll, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            perror("epoll_wait");
+            return 1;
+        }
+        for (int i = 0; i < n; ++i) {
+            u64 id = events[i].data.u64;
+            if (id == 0) {
+                for (int fd; (fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0; ) {
+                    u64 cid = next_id++;
+                    connections[cid] = {.fd=fd};
+                    epoll_event cev = {.events=EPOLLIN, .data={.u64=cid}};
+                    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &cev);
+                }
+                continue;
+            }
+            if (id == 1) {
+                u64 count;
+                read(server.wake, &count, sizeof(count));
+                std::deque<server_reply> replies;
+                {
+                    std::lock_guard<std::mutex> guard(server.lock);
+                    replies.swap(server.replies);
+                }
+                for (auto& reply : replies) {
+                    auto it = connections.find(reply.connection);
+                    // the client hung up while its move was searched
+                    if (it == connections.end()) { continue; }
+                    auto& c = it->second;
+                    c.busy = !reply.last;
+                    c.out += reply.response;
+                    if (!server_serve(server, epoll, it->first, c)) {
+                        close(c.fd);
+                        connections.erase(it);
+                    }
+                }
+            }
+            else {
+                auto it = connections.find(id);
+                if (it == connections.end()) { continue; }
+                auto& c = it->second;
+                u8 hangup = events[i].events & (EPOLLERR | EPOLLHUP);
+                if (events[i].events & EPOLLIN) {
+                    char buffer[0x1000];
+                    for (;;) {
+                        ssize_t k = recv(c.fd, buffer, sizeof(buffer), 0);
+                        if (k > 0) {
+                            c.in.append(buffer, k);
+                            continue;
+                        }
+                        if (k == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) { hangup = 1; }
+                        break;
+                    }
+                }
+                if (hangup || !server_serve(server, epoll, id, c)) {
+                    // a search still running for it ends unanswered
+                    if (c.busy) { *c.abandoned = 1; }
+                    close(c.fd);
+                    connections.erase(it);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,360 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game.h"
+
+
+// Endgame tables: kings plus up to two pawns per side, every prog
+// distribution, both sides to move. One byte per position, from the point
+// of view of the side to move:
+//   0          draw (no forced result, the game can go on forever)
+//   1..127     win in N plies
+//   0x80|N     loss in N plies
+//
+// A side to move without a move loses then and there, loss in 0, as a
+// pass ends the game for the page; the searches in engine.h score it the
+// same way.
+//
+// Positions are indexed by a perfect hash built from the combinatorial
+// rank of each side's pawn squares:
+//   ((((progs * 2 + side) * 600 + kings) * C(25,a) + pawns1) * C(25,b) + pawns2)
+// Slots where pieces overlap or a king stands on its goal are never probed.
+
+
+#define TB_MAGIC "MPTB"
+#define TB_VERSION 1
+#define TB_MAX_PAWNS 2
+
+
+typedef struct {
+    u8 pawns1;
+    u8 pawns2;
+    u8 _reserved[6];
+    u64 offset;
+    u64 size;
+} tb_class_entry;
+
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 classes;
+    u32 _reserved;
+    tb_class_entry entries[(TB_MAX_PAWNS + 1) * (TB_MAX_PAWNS + 1)];
+} tb_header;
+
+
+typedef struct {
+    const u8* data;
+    size_t size;
+} tablebase;
+
+
+static inline
+u8
+tb_is_win(u8 value) {
+    return value && !(value & 0x80);
+}
+
+
+static inline
+u8
+tb_is_loss(u8 value) {
+    return value & 0x80;
+}
+
+
+static inline
+u8
+tb_distance(u8 value) {
+    return value & 0x7f;
+}
+
+
+static inline
+u8
+tb_win(u8 distance) {
+    return distance;
+}
+
+
+static inline
+u8
+tb_loss(u8 distance) {
+    return 0x80 | distance;
+}
+
+
+static inline
+u32
+tb_binom(u32 n, u32 k) {
+    switch (k) {
+        case 0: return 1;
+        case 1: return n;
+        case 2: return n * (n - 1) / 2;
+    }
+    return 0;
+}
+
+
+static inline
+u64
+tb_class_size(u8 pawns1, u8 pawns2) {
+    return u64(30) * 2 * 600 * tb_binom(25, pawns1) * tb_binom(25, pawns2);
+}
+
+
+static inline
+u32
+tb_class_slot(u8 pawns1, u8 pawns2) {
+    return pawns1 * (TB_MAX_PAWNS + 1) + pawns2;
+}
+
+
+// hands are unordered: 5 choices of decked prog, 6 ways to split the rest
+static
+u32
+tb_progs_index(const game_state& state) {
+    u8 decked = state.decked_prog;
+    u8 a = state.p1_progs[0], b = state.p1_progs[1];
+    if (a > b) { u8 t = a; a = b; b = t; }
+    u32 pair = 0;
+    for (u8 i = 0; i < 5; ++i) {
+        if (i == decked) { continue; }
+        for (u8 j = i + 1; j < 5; ++j) {
+            if (j == decked) { continue; }
+            if (i == a && j == b) { return decked * 6 + pair; }
+            ++pair;
+        }
+    }
+    return decked * 6 + pair;
+}
+
+
+static
+void
+tb_progs_decode(u32 index, u8 progs[5]) {
+    u8 decked = index / 6;
+    u32 pair = index % 6;
+    progs[0] = decked;
+    u32 k = 0;
+    for (u8 i = 0; i < 5; ++i) {
+        if (i == decked) { continue; }
+        for (u8 j = i + 1; j < 5; ++j) {
+            if (j == decked) { continue; }
+            if (k++ == pair) {
+                progs[1] = i;
+                progs[2] = j;
+            }
+        }
+    }
+    u32 n = 3;
+    for (u8 i = 0; i < 5; ++i) {
+        if (i != decked && i != progs[1] && i != progs[2]) {
+            progs[n++] = i;
+        }
+    }
+}
+
+
+static inline
+u32
+tb_pawns_rank(const u8* squares, u8 count) {
+    switch (count) {
+        case 1: return squares[0];
+        case 2: return squares[0] + tb_binom(squares[1], 2);
+    }
+    return 0;
+}
+
+
+static inline
+void
+tb_pawns_unrank(u32 rank, u8 count, u8* squares) {
+    if (count == 2) {
+        u8 s = 1;
+        while (tb_binom(s + 1, 2) <= rank) { ++s; }
+        squares[1] = s;
+        rank -= tb_binom(s, 2);
+    }
+    if (count) {
+        squares[0] = rank;
+    }
+}
+
+
+// returns 0 when the position is outside the tables
+static
+u8
+tb_index(const game_state& state, u8* pawns1, u8* pawns2, u64* index) {
+    u8 k1 = 0xff, k2 = 0xff;
+    u8 p1[TB_MAX_PAWNS], p2[TB_MAX_PAWNS];
+    u8 a = 0, b = 0;
+    for (u8 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!piece) { continue; }
+        if (is_own(piece, 1)) {
+            if (is_king(piece)) { k1 = i; }
+            else if (a == TB_MAX_PAWNS) { return 0; }
+            else { p1[a++] = i; }
+        }
+        else {
+            if (is_king(piece)) { k2 = i; }
+            else if (b == TB_MAX_PAWNS) { return 0; }
+            else { p2[b++] = i; }
+        }
+    }
+    if (k1 == 0xff || k2 == 0xff) { return 0; }
+    u64 q = tb_progs_index(state);
+    q = q * 2 + (state.current_player - 1);
+    q = q * 600 + k1 * 24 + (k2 < k1 ? k2 : k2 - 1);
+    q = q * tb_binom(25, a) + tb_pawns_rank(p1, a);
+    q = q * tb_binom(25, b) + tb_pawns_rank(p2, b);
+    *pawns1 = a;
+    *pawns2 = b;
+    *index = q;
+    return 1;
+}
+
+
+// returns 0 for slots that do not hold a legal, unfinished position
+static
+u8
+tb_decode(u8 pawns1, u8 pawns2, u64 index, game_state& state) {
+    u8 p1[TB_MAX_PAWNS], p2[TB_MAX_PAWNS];
+    u32 n2 = tb_binom(25, pawns2);
+    tb_pawns_unrank(index % n2, pawns2, p2);
+    index /= n2;
+    u32 n1 = tb_binom(25, pawns1);
+    tb_pawns_unrank(index % n1, pawns1, p1);
+    index /= n1;
+    u32 kings = index % 600;
+    index /= 600;
+    u8 k1 = kings / 24;
+    u8 k2 = kings % 24;
+    if (k2 >= k1) { ++k2; }
+    if (k1 == 2 || k2 == 22) { return 0; }
+
+    state = {};
+    state.current_player = index % 2 + 1;
+    tb_progs_decode(index / 2, state.progs);
+    state.pieces[k1] = 13;
+    state.pieces[k2] = 23;
+    for (u8 i = 0; i < pawns1; ++i) {
+        if (state.pieces[p1[i]]) { return 0; }
+        state.pieces[p1[i]] = 11 + i;
+    }
+    for (u8 i = 0; i < pawns2; ++i) {
+        if (state.pieces[p2[i]]) { return 0; }
+        state.pieces[p2[i]] = 21 + i;
+    }
+    return 1;
+}
+
+
+static
+u8
+tb_open(tablebase& tb, const char* path) {
+    tb = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || size_t(st.st_size) < sizeof(tb_header)) {
+        fprintf(stderr, "%s: not a tablebase\n", path);
+        close(fd);
+        return 0;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+    auto header = (const tb_header*) p;
+    if (memcmp(header->magic, TB_MAGIC, 4) || header->version != TB_VERSION) {
+        fprintf(stderr, "%s: not a tablebase\n", path);
+        munmap(p, st.st_size);
+        return 0;
+    }
+    for (auto& entry : header->entries) {
+        if (entry.size && entry.offset + entry.size > size_t(st.st_size)) {
+            fprintf(stderr, "%s: truncated tablebase\n", path);
+            munmap(p, st.st_size);
+            return 0;
+        }
+    }
+    tb.data = (const u8*) p;
+    tb.size = st.st_size;
+    return 1;
+}
+
+
+static
+void
+tb_close(tablebase& tb) {
+    if (tb.data) {
+        munmap((void*) tb.data, tb.size);
+    }
+    tb = {};
+}
+
+
+// value is from the point of view of the side to move
+static
+u8
+tb_probe(const tablebase& tb, const game_state& state, u8* value) {
+    if (!tb.data || state.ended) { return 0; }
+    u8 a, b;
+    u64 index;
+    if (!tb_index(state, &a, &b, &index)) { return 0; }
+    auto header = (const tb_header*) tb.data;
+    auto& entry = header->entries[tb_class_slot(a, b)];
+    if (!entry.size) { return 0; }
+    *value = tb.data[entry.offset + index];
+    return 1;
+}
+
+
+// The table's move at the root: the quickest win, a draw, or the slowest
+// loss; score is the result for the side to move, 1 a win and 0.5 a draw.
+// Returns 0 when the position is not in the tables.
+static
+u8
+tb_probe_move(const tablebase& tb, const game_state& state, player_move* mv, r64* score = nullptr) {
+    u8 value = 0;
+    if (!tb_probe(tb, state, &value)) { return 0; }
+    auto valid = valid_moves(state, state.current_player);
+    if (valid.empty()) { return 0; }
+    // ranked as wins shortest first, then draws, then losses longest first
+    i32 best_rank = -1000;
+    auto next = state;
+    move_undo undo;
+    for (auto& q : valid) {
+        i32 rank = 0;
+        if (is_winning_move(next, q)) {
+            rank = 1000 - 1;
+        }
+        else {
+            make_move(next, q, undo);
+            u8 reply = 0;
+            u8 known = tb_probe(tb, next, &reply);
+            unmake_move(next, undo);
+            if (!known) { return 0; }
+            if (tb_is_loss(reply)) { rank = 1000 - tb_distance(reply) - 1; }
+            else if (tb_is_win(reply)) { rank = tb_distance(reply) + 1 - 1000; }
+        }
+        if (rank > best_rank) {
+            best_rank = rank;
+            *mv = q;
+        }
+    }
+    if (score) { *score = best_rank > 0 ? 1 : best_rank < 0 ? 0 : 0.5; }
+    return 1;
+}
@@ -0,0 +1,317 @@
+// cc -std=c++20 -lc++ -O3 -pthread -o tbgen tbgen.cpp
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "game.h"
+#include "tablebase.h"
+
+
+namespace chrono = std::chrono;
+using std::vector;
+
+
+#define TB_NO_LOSS 0xff
+#define TB_CANDIDATE (u64(1) << 63)
+
+
+typedef struct {
+    u8 pawns1;
+    u8 pawns2;
+    u64 size;
+    vector<u8> values;
+} tb_class;
+
+
+typedef struct {
+    tb_class classes[(TB_MAX_PAWNS + 1) * (TB_MAX_PAWNS + 1)];
+} tb_tables;
+
+
+typedef struct {
+    tb_class* cls;
+    const tb_tables* tables;
+    vector<u8> count;
+    vector<u8> longest;
+    vector<vector<u64>> levels;
+} tb_solver;
+
+
+static
+u8
+tb_lookup(const tb_tables& tables, const game_state& state) {
+    u8 a, b;
+    u64 index;
+    tb_index(state, &a, &b, &index);
+    return tables.classes[tb_class_slot(a, b)].values[index];
+}
+
+
+static
+void
+tb_push(tb_solver& solver, u32 distance, u64 entry) {
+    if (distance > 0x7f) {
+        fprintf(stderr, "distance overflow\n");
+        exit(1);
+    }
+    if (solver.levels.size() <= distance) {
+        solver.levels.resize(distance + 1);
+    }
+    solver.levels[distance].push_back(entry);
+}
+
+
+// forward pass: resolve what is known from terminal and capturing moves,
+// count the moves that stay within the class
+static
+void
+tb_init_range(tb_solver& solver, u64 start, u64 end, vector<vector<u64>>& levels) {
+    tb_class& cls = *solver.cls;
+    auto push = [&](u32 distance, u64 entry) {
+        if (levels.size() <= distance) { levels.resize(distance + 1); }
+        levels[distance].push_back(entry);
+    };
+    for (u64 q = start; q < end; ++q) {
+        game_state state;
+        if (!tb_decode(cls.pawns1, cls.pawns2, q, state)) { continue; }
+        auto valid = valid_moves(state, state.current_player);
+        // no move loses, see tablebase.h
+        if (valid.empty()) {
+            cls.values[q] = tb_loss(0);
+            push(0, q);
+            continue;
+        }
+        u8 best_win = 0, longest = 0, count = 0, draw = 0;
+        for (auto& mv : valid) {
+            auto next = next_state(state, mv);
+            u8 value = 0;
+            if (next.ended) {
+                value = tb_loss(0);
+            }
+            else {
+                u8 a, b;
+                u64 index;
+                tb_index(next, &a, &b, &index);
+                if (a == cls.pawns1 && b == cls.pawns2) {
+                    ++count;
+                    continue;
+                }
+                value = tb_lookup(*solver.tables, next);
+            }
+            if (tb_is_loss(value)) {
+                u8 d = tb_distance(value) + 1;
+                if (!best_win || d < best_win) { best_win = d; }
+            }
+            else if (tb_is_win(value)) {
+                if (tb_distance(value) > longest) { longest = tb_distance(value); }
+            }
+            else {
+                draw = 1;
+            }
+        }
+        solver.longest[q] = longest;
+        solver.count[q] = (best_win || draw) ? TB_NO_LOSS : count;
+        if (best_win) {
+            push(best_win, q | TB_CANDIDATE);
+        }
+        else if (!count && !draw) {
+            cls.values[q] = tb_loss(longest + 1);
+            push(longest + 1, q);
+        }
+    }
+}
+
+
+template <typename F>
+static
+void
+tb_predecessors(const tb_class& cls, u64 q, F&& visit) {
+    game_state state;
+    tb_decode(cls.pawns1, cls.pawns2, q, state);
+    u8 mover = 3 - state.current_player;
+    i8 rotate = 3 - 2 * mover;
+    u8 pid = state.decked_prog;
+    for (u8 i = 0; i < 25; ++i) {
+        u8 piece = state.pieces[i];
+        if (!is_own(piece, mover)) { continue; }
+        u8 to = (i / 5) * 10 + i % 5;
+        for (i8 d : Progs[pid]) {
+            if (!d) { continue; }
+            u8 from = to - d * rotate;
+            if (!on_board(from)) { continue; }
+            if (get_piece(state, from)) { continue; }
+            auto prev = state;
+            prev.current_player = mover;
+            set_piece(prev, to, 0);
+            set_piece(prev, from, piece);
+            if (is_terminal(prev)) { continue; }
+            for (u8 k = 0; k < 2; ++k) {
+                auto pred = prev;
+                pred.decked_prog = state.player_progs[mover-1][k];
+                pred.player_progs[mover-1][k] = pid;
+                u8 a, b;
+                u64 index;
+                tb_index(pred, &a, &b, &index);
+                visit(index);
+            }
+        }
+    }
+}
+
+
+static
+void
+tb_solve(tb_class& cls, const tb_tables& tables, u32 threads) {
+    tb_solver solver = {.cls=&cls, .tables=&tables};
+    cls.values.assign(cls.size, 0);
+    solver.count.assign(cls.size, 0);
+    solver.longest.assign(cls.size, 0);
+
+    vector<vector<vector<u64>>> levels(threads);
+    vector<std::thread> workers;
+    u64 chunk = (cls.size + threads - 1) / threads;
+    for (u32 t = 0; t < threads; ++t) {
+        u64 start = t * chunk;
+        u64 end = std::min(cls.size, start + chunk);
+        workers.emplace_back([&solver, &levels, t, start, end]() {
+            tb_init_range(solver, start, end, levels[t]);
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+    for (auto& part : levels) {
+        for (u32 d = 0; d < part.size(); ++d) {
+            for (u64 q : part[d]) { tb_push(solver, d, q); }
+        }
+    }
+
+    // retrograde pass, one distance level at a time
+    for (u32 d = 0; d < solver.levels.size(); ++d) {
+        for (u64 i = 0; i < solver.levels[d].size(); ++i) {
+            u64 q = solver.levels[d][i];
+            if (q & TB_CANDIDATE) {
+                q &= ~TB_CANDIDATE;
+                if (cls.values[q]) { continue; }
+                cls.values[q] = tb_win(d);
+            }
+            u8 value = cls.values[q];
+            if (tb_is_loss(value)) {
+                tb_predecessors(cls, q, [&](u64 p) {
+                    if (cls.values[p]) { return; }
+                    cls.values[p] = tb_win(d + 1);
+                    tb_push(solver, d + 1, p);
+                });
+            }
+            else {
+                tb_predecessors(cls, q, [&](u64 p) {
+                    if (cls.values[p]) { return; }
+                    if (d > solver.longest[p]) { solver.longest[p] = d; }
+                    if (solver.count[p] == TB_NO_LOSS) { return; }
+                    if (--solver.count[p]) { return; }
+                    u8 dist = solver.longest[p] + 1;
+                    cls.values[p] = tb_loss(dist);
+                    tb_push(solver, dist, p);
+                });
+            }
+        }
+        solver.levels[d] = {};
+    }
+}
+
+
+static
+void
+tb_report(const tb_class& cls, r64 elapsed) {
+    u64 wins = 0, losses = 0, draws = 0;
+    u8 longest = 0;
+    for (u64 q = 0; q < cls.size; ++q) {
+        game_state state;
+        if (!tb_decode(cls.pawns1, cls.pawns2, q, state)) { continue; }
+        u8 value = cls.values[q];
+        if (tb_is_win(value)) { ++wins; }
+        else if (tb_is_loss(value)) { ++losses; }
+        else { ++draws; }
+        if (tb_distance(value) > longest) { longest = tb_distance(value); }
+    }
+    fprintf(stderr, "class %u-%u: %" PRIu64 " wins, %" PRIu64 " losses, %" PRIu64 " draws, longest %u plies (%.1fs)\n",
+        cls.pawns1, cls.pawns2, wins, losses, draws, longest, elapsed);
+}
+
+
+static
+void
+usage(const char* name) {
+    fprintf(stderr, "usage: %s [-p pawns] [-j threads] [-o path]\n", name);
+    fprintf(stderr, "  -p  pawns per side, 0..%u (default 1)\n", TB_MAX_PAWNS);
+    fprintf(stderr, "  -j  worker threads (default: all cores)\n");
+    fprintf(stderr, "  -o  output file (default brute.tb)\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    u32 max_pawns = 1;
+    u32 threads = std::thread::hardware_concurrency();
+    const char* path = "brute.tb";
+    for (int opt; (opt = getopt(argc, argv, "p:j:o:h")) != -1; ) {
+        switch (opt) {
+            case 'p': max_pawns = atoi(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'o': path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (max_pawns > TB_MAX_PAWNS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!threads) { threads = 1; }
+
+    tb_tables tables = {};
+    tb_header header = {};
+    memcpy(header.magic, TB_MAGIC, 4);
+    header.version = TB_VERSION;
+    u64 offset = sizeof(header);
+
+    // captures only ever lead to classes with fewer pawns
+    for (u32 total = 0; total <= 2 * max_pawns; ++total) {
+        for (u32 a = 0; a <= max_pawns; ++a) {
+            if (total < a || total - a > max_pawns) { continue; }
+            u32 b = total - a;
+            auto start = chrono::steady_clock::now();
+            tb_class& cls = tables.classes[tb_class_slot(a, b)];
+            cls.pawns1 = a;
+            cls.pawns2 = b;
+            cls.size = tb_class_size(a, b);
+            tb_solve(cls, tables, threads);
+            chrono::duration<r64> elapsed = chrono::steady_clock::now() - start;
+            tb_report(cls, elapsed.count());
+
+            auto& entry = header.entries[tb_class_slot(a, b)];
+            entry.pawns1 = a;
+            entry.pawns2 = b;
+            entry.offset = offset;
+            entry.size = cls.size;
+            offset += cls.size;
+            ++header.classes;
+        }
+    }
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    u8 ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (auto& cls : tables.classes) {
+        if (!cls.size) { continue; }
+        ok = ok && fwrite(cls.values.data(), 1, cls.size, fp) == cls.size;
+    }
+    if (fclose(fp) || !ok) {
+        perror(path);
+        return 1;
+    }
+    fprintf(stderr, "%s: %" PRIu64 " bytes\n", path, offset);
+    return 0;
+}
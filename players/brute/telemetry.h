@@ -0,0 +1,159 @@
+#pragma once
+#include <cinttypes>
+#include <cstdio>
+#include <unordered_map>
+#include "game.h"
+
+
+// One record per search, written as a JSON line. Phases are what a
+// playout spends its time on: walking the tree, scoring the leaf (a dive
+// or the network), and backing the result up the path. Root lists every
+// root move with its visits and score. Tactics, when portfolio_move ran
+// them, has how far they got and the search's pick they replaced, if any.
+
+
+// as many moves as a position can have
+#define METRICS_ROOT (5 * 2 * 4)
+
+
+// a root move as the search left it; score is its win rate for the side
+// to move, visits the playouts through it
+typedef struct {
+    player_move move;
+    u32 visits;
+    r64 score;
+} metrics_root_move;
+
+
+typedef struct {
+    const char* engine;
+    u32 playouts;
+    r64 seconds;
+    u64 nodes;
+    u64 bytes;
+    r64 load_factor;
+    r64 mean_probe;
+    u32 max_probe;
+    u32 max_depth;
+    u64 dives;
+    u64 dive_plies;
+    r64 select_seconds;
+    r64 leaf_seconds;
+    r64 backup_seconds;
+    player_move move;
+    r64 score;
+    r64 share;
+    u32 tactic_depth; // plies finished
+    u64 tactic_nodes; // 0 when the tactics did not run
+    u32 tactic_losing; // root moves lost by force
+    u8 tactic_override;
+    player_move tactic_replaced; // the search's pick, when it lost by force
+    u32 root_count;
+    metrics_root_move root[METRICS_ROOT];
+} search_metrics;
+
+
+// size, load and chain lengths of a node table; mean_probe is the average
+// chain walked to find a key that is there
+template<typename K, typename V>
+static
+void
+metrics_table(search_metrics& m, const std::unordered_map<K,V>& table) {
+    m.nodes = table.size();
+    m.bytes = table.size() * (sizeof(typename std::unordered_map<K,V>::value_type) + sizeof(void*)) +
+        table.bucket_count() * sizeof(void*);
+    m.load_factor = table.load_factor();
+    u64 probes = 0;
+    u32 longest = 0;
+    for (size_t b = 0; b < table.bucket_count(); ++b) {
+        u64 n = table.bucket_size(b);
+        probes += n * (n + 1) / 2;
+        if (n > longest) { longest = n; }
+    }
+    m.mean_probe = table.size() ? r64(probes) / table.size() : 0;
+    m.max_probe = longest;
+}
+
+
+static inline
+void
+metrics_root(search_metrics& m, const player_move& mv, u32 visits, r64 score) {
+    if (m.root_count < METRICS_ROOT) { m.root[m.root_count++] = {mv, visits, score}; }
+}
+
+
+static
+void
+metrics_write(FILE* out, const search_metrics& m) {
+    flockfile(out);
+    fprintf(out, "{\"engine\":\"%s\",\"playouts\":%u,\"playouts_per_second\":%.0f,\"seconds\":%.4f,"
+        "\"nodes\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"load_factor\":%.3f,\"mean_probe\":%.3f,\"max_probe\":%u,"
+        "\"max_depth\":%u,\"dives\":%" PRIu64 ",\"mean_dive\":%.2f,"
+        "\"phases\":{\"select\":%.4f,\"leaf\":%.4f,\"backup\":%.4f},",
+        m.engine, m.playouts, m.seconds > 0 ? m.playouts / m.seconds : 0, m.seconds,
+        m.nodes, m.bytes, m.load_factor, m.mean_probe, m.max_probe,
+        m.max_depth, m.dives, m.dives ? r64(m.dive_plies) / m.dives : 0,
+        m.select_seconds, m.leaf_seconds, m.backup_seconds);
+    fprintf(out, "\"root\":[");
+    for (u32 i = 0; i < m.root_count; ++i) {
+        auto& r = m.root[i];
+        fprintf(out, "%s{\"from\":%u,\"to\":%u,\"pid\":%u,\"visits\":%u,\"score\":%.4f}",
+            i ? "," : "", r.move.from, r.move.to, r.move.pid, r.visits, r.score);
+    }
+    fprintf(out, "],");
+    if (m.tactic_nodes) {
+        fprintf(out, "\"tactics\":{\"depth\":%u,\"nodes\":%" PRIu64 ",\"losing\":%u,\"replaced\":",
+            m.tactic_depth, m.tactic_nodes, m.tactic_losing);
+        if (m.tactic_override) {
+            fprintf(out, "{\"from\":%u,\"to\":%u,\"pid\":%u}},",
+                m.tactic_replaced.from, m.tactic_replaced.to, m.tactic_replaced.pid);
+        }
+        else {
+            fprintf(out, "null},");
+        }
+    }
+    if (m.move.v == player_pass.v) {
+        fprintf(out, "\"move\":null}\n");
+    }
+    else {
+        fprintf(out, "\"move\":{\"from\":%u,\"to\":%u,\"pid\":%u,\"score\":%.4f,\"share\":%.4f}}\n",
+            m.move.from, m.move.to, m.move.pid, m.score, m.share);
+    }
+    fflush(out);
+    funlockfile(out);
+}
+
+
+// The search so far, as a client may take it before the search is over:
+// the move it would play now, and the line of most visited replies below.
+#define SNAPSHOT_PV 8
+
+
+typedef struct {
+    player_move move;
+    r64 score;
+    u32 visits;
+    u32 playouts;
+    r64 seconds;
+    u32 pv_length;
+    player_move pv[SNAPSHOT_PV];
+} search_snapshot;
+
+
+// as one line of JSON, without the newline; the length snprintf gives
+static
+int
+snapshot_json(char* out, size_t size, const search_snapshot& s) {
+    int n = snprintf(out, size, "{\"move\":");
+    auto put = [&](const char* format, auto... args) {
+        if (n >= 0 && size_t(n) < size) { n += snprintf(out + n, size - n, format, args...); }
+    };
+    if (s.move.v == player_pass.v) { put("null"); }
+    else { put("[%u,%u,%u]", s.move.from, s.move.to, s.move.pid); }
+    put(",\"score\":%.4f,\"visits\":%u,\"playouts\":%u,\"seconds\":%.4f,\"pv\":[", s.score, s.visits, s.playouts, s.seconds);
+    for (u32 i = 0; i < s.pv_length; ++i) {
+        put("%s[%u,%u,%u]", i ? "," : "", s.pv[i].from, s.pv[i].to, s.pv[i].pid);
+    }
+    put("]}");
+    return n;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game.h"
+
+
+// Node statistics shared by every brute process through one mmap'd file.
+// Slots are seqlocked: a writer claims a slot by moving its version from
+// even to odd, readers retry or give up when the version changes under
+// them. Writers never wait, a contended update is simply dropped.
+
+
+#define TT_MAGIC "MPTT"
+#define TT_VERSION 1
+#define TT_BUCKET 4
+
+
+typedef struct {
+    std::atomic<u64> version;
+    std::atomic<u64> key;
+    std::atomic<u32> wins;
+    std::atomic<u32> rounds;
+} tt_slot;
+
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u64 slots;
+} tt_header;
+
+
+typedef struct {
+    tt_header* header;
+    tt_slot* slots;
+    u64 mask;
+    size_t size;
+} shared_table;
+
+
+static_assert(std::atomic<u64>::is_always_lock_free, "shared slots need lock-free atomics");
+
+
+static
+u8
+tt_open(shared_table& tt, const char* path, u64 megabytes) {
+    tt = {};
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    flock(fd, LOCK_EX);
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = st.st_size;
+    if (!size) {
+        u64 slots = 1;
+        while (slots * 2 * sizeof(tt_slot) <= megabytes * 0x100000) { slots *= 2; }
+        size = sizeof(tt_header) + slots * sizeof(tt_slot);
+        if (ftruncate(fd, size)) {
+            perror(path);
+            flock(fd, LOCK_UN);
+            close(fd);
+            return 0;
+        }
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror(path);
+        flock(fd, LOCK_UN);
+        close(fd);
+        return 0;
+    }
+    auto header = (tt_header*) p;
+    if (!st.st_size) {
+        memcpy(header->magic, TT_MAGIC, 4);
+        header->version = TT_VERSION;
+        header->slots = (size - sizeof(tt_header)) / sizeof(tt_slot);
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    u64 slots = header->slots;
+    if (memcmp(header->magic, TT_MAGIC, 4) || header->version != TT_VERSION ||
+        (slots & (slots - 1)) || sizeof(tt_header) + slots * sizeof(tt_slot) > size) {
+        fprintf(stderr, "%s: not a shared table\n", path);
+        munmap(p, size);
+        return 0;
+    }
+    tt.header = header;
+    tt.slots = (tt_slot*)(header + 1);
+    tt.mask = slots - 1;
+    tt.size = size;
+    return 1;
+}
+
+
+static
+void
+tt_close(shared_table& tt) {
+    if (tt.header) {
+        munmap(tt.header, tt.size);
+    }
+    tt = {};
+}
+
+
+static inline
+u64
+tt_bucket(const shared_table& tt, u64 key) {
+    return ((key * 0x9e3779b97f4a7c15ULL) >> 20) & tt.mask & ~u64(TT_BUCKET - 1);
+}
+
+
+static
+u8
+tt_read(const shared_table& tt, u64 key, u32* wins, u32* rounds) {
+    if (!tt.header) { return 0; }
+    u64 b = tt_bucket(tt, key);
+    for (u32 i = 0; i < TT_BUCKET; ++i) {
+        tt_slot& slot = tt.slots[b + i];
+        u64 v1 = slot.version.load(std::memory_order_acquire);
+        if (v1 & 1) { continue; }
+        if (slot.key.load(std::memory_order_relaxed) != key) { continue; }
+        u32 w = slot.wins.load(std::memory_order_relaxed);
+        u32 r = slot.rounds.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.load(std::memory_order_relaxed) != v1) { continue; }
+        *wins = w;
+        *rounds = r;
+        return 1;
+    }
+    return 0;
+}
+
+
+// adds to the slot holding key, or replaces the least visited one
+static
+void
+tt_add(shared_table& tt, u64 key, u32 wins, u32 rounds) {
+    if (!tt.header || !rounds) { return; }
+    u64 b = tt_bucket(tt, key);
+    tt_slot* victim = nullptr;
+    u32 victim_rounds = -1;
+    for (u32 i = 0; i < TT_BUCKET; ++i) {
+        tt_slot& slot = tt.slots[b + i];
+        u64 k = slot.key.load(std::memory_order_relaxed);
+        u32 r = slot.rounds.load(std::memory_order_relaxed);
+        if (k == key) {
+            victim = &slot;
+            break;
+        }
+        if (r < victim_rounds) {
+            victim = &slot;
+            victim_rounds = r;
+        }
+    }
+    tt_slot& slot = *victim;
+    u64 v = slot.version.load(std::memory_order_relaxed);
+    if ((v & 1) || !slot.version.compare_exchange_strong(v, v + 1, std::memory_order_acquire)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    u32 w = 0, r = 0;
+    if (slot.key.load(std::memory_order_relaxed) == key) {
+        w = slot.wins.load(std::memory_order_relaxed);
+        r = slot.rounds.load(std::memory_order_relaxed);
+    }
+    w += wins;
+    r += rounds;
+    if (r >= 0x40000000) {
+        w /= 2;
+        r /= 2;
+    }
+    slot.key.store(key, std::memory_order_relaxed);
+    slot.wins.store(w, std::memory_order_relaxed);
+    slot.rounds.store(r, std::memory_order_relaxed);
+    slot.version.store(v + 2, std::memory_order_release);
+}